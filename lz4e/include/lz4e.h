@@ -7,48 +7,419 @@
 #define LZ4E_NAME "lz4e"
 
 #define LZ4E_ACCELERATION_DEFAULT 1
+#define LZ4E_ACCELERATION_MAX 65537
 
 #define LZ4E_MEMORY_USAGE	14
 #define LZ4E_HASHLOG		(LZ4E_MEMORY_USAGE - 2)
 #define LZ4E_HASH_SIZE_U32	(1 << LZ4E_HASHLOG)
 #define LZ4E_HASH_SIZE_U64	(LZ4E_HASH_SIZE_U32 >> 1)
-#define LZ4E_BV_ITER_SIZE_U64	(BIO_MAX_VECS >> 1)
+
+#define LZ4E_SEG_MAX		BIO_MAX_VECS
+#define LZ4E_SEG_LUT_LOG	8
+#define LZ4E_SEG_LUT_SIZE	(1 << LZ4E_SEG_LUT_LOG)
+#define LZ4E_SEGTAB_SIZE_U64	\
+	(((LZ4E_SEG_MAX + 1) * 4 + LZ4E_SEG_LUT_SIZE * 2 + 12 + 7) / 8)
+
+#define LZ4E_DICTVECS_SIZE_U64	\
+	((LZ4E_SEG_MAX * sizeof(struct bio_vec) + 7) / 8)
 
 #define LZ4E_STREAMSIZE_U64	\
-	(LZ4E_HASH_SIZE_U64 + LZ4E_BV_ITER_SIZE_U64 + 4)
+	(LZ4E_HASH_SIZE_U64 + 2 * LZ4E_SEGTAB_SIZE_U64 \
+	+ LZ4E_DICTVECS_SIZE_U64 + 6)
 #define LZ4E_STREAMSIZE		\
 	(LZ4E_STREAMSIZE_U64 * sizeof(unsigned long long))
 
 #define LZ4E_MEM_COMPRESS LZ4E_STREAMSIZE
 
+#define LZ4E_HC_MIN_CLEVEL	3
+#define LZ4E_HC_DEFAULT_CLEVEL	9
+#define LZ4E_HC_MAX_CLEVEL	16
+
+#define LZ4E_HC_DICTIONARY_LOGSIZE	16
+#define LZ4E_HC_MAXD		(1 << LZ4E_HC_DICTIONARY_LOGSIZE)
+#define LZ4E_HC_MAXD_MASK	(LZ4E_HC_MAXD - 1)
+#define LZ4E_HC_HASH_LOG	(LZ4E_HC_DICTIONARY_LOGSIZE - 1)
+#define LZ4E_HC_HASHTABLESIZE	(1 << LZ4E_HC_HASH_LOG)
+#define LZ4E_HC_HASH_MASK	(LZ4E_HC_HASHTABLESIZE - 1)
+
+#define LZ4E_STREAMHCSIZE_U64	\
+	((LZ4E_HC_HASHTABLESIZE * 4 + LZ4E_HC_MAXD * 2) / 8 \
+	+ LZ4E_SEGTAB_SIZE_U64 + 2)
+#define LZ4E_STREAMHCSIZE	\
+	(LZ4E_STREAMHCSIZE_U64 * sizeof(unsigned long long))
+
+#define LZ4E_HC_MEM_COMPRESS LZ4E_STREAMHCSIZE
+
 #define LZ4E_MAX_INPUT_SIZE		0x7E000000 /* 2 113 929 216 bytes */
 #define LZ4E_COMPRESSBOUND(isize)	(\
 	(unsigned int)(isize) > (unsigned int)LZ4E_MAX_INPUT_SIZE \
 	? 0 \
 	: (isize) + ((isize)/255) + 16)
 
+/* Returned by LZ4E_compress_probe() when the probe finds no matches */
+#define LZ4E_INCOMPRESSIBLE		(-1)
+
+/*
+ * Block-framed data: a 4-byte input size and a 4-byte compressed size of
+ * every block, followed by the independently compressed blocks.
+ * All fields are little-endian.
+ */
+#define LZ4E_BLOCK_SIZE			(64 * 1024)
+#define LZ4E_BLOCKS_COUNT(isize)	\
+	(((isize) + LZ4E_BLOCK_SIZE - 1) / LZ4E_BLOCK_SIZE)
+#define LZ4E_BLOCKS_HEADER_SIZE(blocks)	(4 + 4 * (blocks))
+#define LZ4E_BLOCKS_BOUND(isize)	(\
+	(unsigned int)(isize) > (unsigned int)LZ4E_MAX_INPUT_SIZE \
+	? 0 \
+	: (isize) + ((isize)/255) \
+	+ LZ4E_BLOCKS_COUNT(isize) * 20 + 4)
+
+/*
+ * LZ4E_segtab_t - positions of source bvecs for translating input positions
+ * into iterators. A position is looked up in 'lut' by its granule of
+ * (1 << shift) bytes, which gives the first bvec overlapping the granule.
+ * If every bvec is a whole page, 'pages' is set and 'lut' is not filled.
+ */
+typedef struct {
+	uint32_t start[LZ4E_SEG_MAX + 1];
+	uint16_t lut[LZ4E_SEG_LUT_SIZE];
+	uint32_t lead;
+	uint32_t shift;
+	uint32_t pages;
+} LZ4E_segtab_t;
+
 /*
  * LZ4E_stream_t - information structure to track an LZ4E stream.
+ * The dictionary is kept as descriptors of the last 64KB of data
+ * that preceded the current input, the data itself stays in place.
  */
 typedef struct {
-	uint32_t bvIterSize[BIO_MAX_VECS];
+	LZ4E_segtab_t segTable;
+	LZ4E_segtab_t dictSegTable;
+	struct bio_vec dictVecs[LZ4E_SEG_MAX];
+	struct bvec_iter dictIter;
 	uint32_t hashTable[LZ4E_HASH_SIZE_U32];
 	uint32_t currentOffset;
+	uint32_t tableType;
 	uint32_t initCheck;
-	const uint8_t *dictionary;
-	uint8_t *bufferStart;
-	uint32_t dictSize;
+	uint32_t favorDecSpeed;
+	uint32_t skipSameFilled;
 } LZ4E_stream_t_internal;
 typedef union {
 	unsigned long long table[LZ4E_STREAMSIZE_U64];
 	LZ4E_stream_t_internal internal_donotuse;
 } LZ4E_stream_t;
 
+/*
+ * LZ4E_streamHC_t - information structure to track an LZ4E HC stream.
+ * Unlike the fast stream, every input position is kept in the hash chains.
+ */
+typedef struct {
+	LZ4E_segtab_t segTable;
+	uint32_t hashTable[LZ4E_HC_HASHTABLESIZE];
+	uint16_t chainTable[LZ4E_HC_MAXD];
+	uint32_t currentOffset;
+	uint32_t nextToUpdate;
+	uint32_t favorDecSpeed;
+} LZ4E_streamHC_t_internal;
+typedef union {
+	unsigned long long table[LZ4E_STREAMHCSIZE_U64];
+	LZ4E_streamHC_t_internal internal_donotuse;
+} LZ4E_streamHC_t;
+
+/*
+ * LZ4E_compress_default() - compress data from 'src' into 'dst'
+ * 'wrkmem' must be LZ4E_MEM_COMPRESS bytes and zeroed before the first use,
+ * either at allocation or with LZ4E_resetStream(). It can then be reused
+ * for subsequent calls without clearing.
+ */
 int LZ4E_compress_default(const struct bio_vec *src, struct bio_vec *dst,
 		struct bvec_iter *srcIter, struct bvec_iter *dstIter, void *wrkmem);
 
-int LZ4E_decompress_safe(const char *source, char *dest,
-		int compressedSize, int maxDecompressedSize);
+/*
+ * LZ4E_compress_fast() - same as LZ4E_compress_default(), but allows to select
+ * an 'acceleration' factor. The larger it is, the faster the compression
+ * and the worse the ratio. Values below 1 are replaced by
+ * LZ4E_ACCELERATION_DEFAULT, values above LZ4E_ACCELERATION_MAX are capped.
+ */
+int LZ4E_compress_fast(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int acceleration, void *wrkmem);
+
+/*
+ * LZ4E_compress_probe() - same as LZ4E_compress_fast(), but gives up
+ * early on data that does not compress. If no match is found within
+ * the first 'probeSize' bytes of the input, LZ4E_INCOMPRESSIBLE is
+ * returned and the iterators are left untouched, so the caller can store
+ * the data as is, having spent the CPU on the probe only. 'probeSize' of 0,
+ * or not smaller than the input, disables the probe.
+ */
+int LZ4E_compress_probe(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int acceleration, unsigned int probeSize, void *wrkmem);
+
+/*
+ * LZ4E_compress_destSize() - compress as much of the data from 'src' as
+ * fits into the 'dstIter->bi_size' bytes of 'dst'. 'srcIter' is moved past
+ * the consumed input, so the amount of it is the difference in its
+ * 'bi_size', and the rest can be compressed by another call. 'wrkmem' is
+ * the same as for LZ4E_compress_fast().
+ * Returns the number of bytes written to 'dst', never more than its size,
+ * or 0 on failure.
+ */
+int LZ4E_compress_destSize(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		void *wrkmem);
+
+/*
+ * LZ4E_compress_fast_xxh32() - same as LZ4E_compress_fast(), but also
+ * computes the xxHash32 (seed 0) of the input into '*checksum'. The input
+ * is hashed in spans of a few KB right after they are encoded, while still
+ * in cache, instead of taking another pass over the pages. The checksum is
+ * only written on success, 'checksum' may be NULL.
+ */
+int LZ4E_compress_fast_xxh32(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int acceleration, uint32_t *checksum, void *wrkmem);
+
+/*
+ * LZ4E_same_filled() - check whether the data at 'iter' repeats a single
+ * word, such as zero pages. If so, the word is written to '*pattern'.
+ * The data is compared a few words at a time and the check stops at the
+ * first mismatch, so it is cheap for data that is not same-filled.
+ * LZ4E_compress_fast() does this check itself and encodes such data
+ * without searching for matches, unless LZ4E_skipSameFilled() is set.
+ */
+bool LZ4E_same_filled(const struct bio_vec *src, struct bvec_iter iter,
+		unsigned long *pattern);
+
+/*
+ * LZ4E_resetStream() - fully clear working memory
+ */
+void LZ4E_resetStream(LZ4E_stream_t *stream);
+
+/*
+ * LZ4E_favorDecompressionSpeed() - when 'favor' is nonzero, the following
+ * compressions with 'stream' as working memory skip matches at offsets
+ * below 8. Such matches overlap the data being copied and keep
+ * the decoder off its fast path, so the output decompresses faster
+ * at the cost of a slightly worse ratio. The setting stays until it is
+ * changed or the stream is reset.
+ */
+void LZ4E_favorDecompressionSpeed(LZ4E_stream_t *stream, int favor);
+
+/*
+ * LZ4E_skipSameFilled() - when 'skip' is nonzero, the following
+ * compressions with 'stream' as working memory do not check whether
+ * the input is same-filled, for callers that have already checked it
+ * with LZ4E_same_filled(). The setting stays until it is changed or
+ * the stream is reset.
+ */
+void LZ4E_skipSameFilled(LZ4E_stream_t *stream, int skip);
+
+/*
+ * LZ4E_loadDict() - use the last 64KB of 'dict' as the dictionary for
+ * the following LZ4E_compress_fast_continue() calls. The stream is reset
+ * beforehand. Only bvec descriptors are kept, so the data has to stay in
+ * place until the dictionary is replaced.
+ * Returns the size of the loaded dictionary.
+ */
+int LZ4E_loadDict(LZ4E_stream_t *stream, const struct bio_vec *dict,
+		struct bvec_iter dictIter);
+
+/*
+ * LZ4E_saveDict() - copy the dictionary into 'safeBuffer' and use it from
+ * there, so that the previously compressed data can be released.
+ * At most 64KB are copied, limited by the size of 'safeIter'.
+ * Returns the size of the saved dictionary.
+ */
+int LZ4E_saveDict(LZ4E_stream_t *stream, struct bio_vec *safeBuffer,
+		struct bvec_iter safeIter);
+
+/*
+ * LZ4E_compress_fast_continue() - compress data from 'src' into 'dst'
+ * referencing up to 64KB of the previously compressed data of the stream.
+ * The stream has to be started with LZ4E_resetStream() or LZ4E_loadDict().
+ * The last 64KB of the previous inputs have to stay in place until
+ * the next call, or be moved with LZ4E_saveDict().
+ * After a failure, the stream has to be reset before it is used again.
+ */
+int LZ4E_compress_fast_continue(LZ4E_stream_t *stream,
+		const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int acceleration);
+
+/*
+ * LZ4E_compress_blocks() - compress data from 'src' into 'dst' as
+ * a sequence of independent blocks of LZ4E_BLOCK_SIZE bytes, preceded by
+ * an index of their compressed sizes. Each block fits into the 2-byte
+ * hash table and covers few enough bvecs, whatever the size of the input.
+ * 'dst' should hold LZ4E_BLOCKS_BOUND() bytes for the compression
+ * to always succeed. 'wrkmem' is the same as for LZ4E_compress_fast().
+ * Returns the number of bytes written to 'dst', or 0 on failure.
+ */
+int LZ4E_compress_blocks(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int acceleration, void *wrkmem);
+
+/*
+ * LZ4E_compress_HC() - compress data from 'src' into 'dst' with
+ * the high compression algorithm. 'compressionLevel' is clamped to
+ * [LZ4E_HC_MIN_CLEVEL, LZ4E_HC_MAX_CLEVEL], values below 1 select
+ * LZ4E_HC_DEFAULT_CLEVEL. 'wrkmem' must be LZ4E_HC_MEM_COMPRESS bytes
+ * and zeroed before the first use, either at allocation or with
+ * LZ4E_resetStreamHC(). The output is a standard LZ4 block.
+ */
+int LZ4E_compress_HC(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		int compressionLevel, void *wrkmem);
+
+/*
+ * LZ4E_resetStreamHC() - fully clear HC working memory
+ */
+void LZ4E_resetStreamHC(LZ4E_streamHC_t *stream);
+
+/*
+ * LZ4E_favorDecompressionSpeedHC() - same as LZ4E_favorDecompressionSpeed()
+ * for HC working memory. Matches of 19 to 36 bytes are also cut down to
+ * 18 bytes, which the decoder copies without reading extra length bytes.
+ * The cut bytes are not encoded on their own: the parser searches again
+ * from the end of the cut match and leaves them to the following sequences,
+ * as a match or as literals.
+ */
+void LZ4E_favorDecompressionSpeedHC(LZ4E_streamHC_t *stream, int favor);
+
+/*
+ * LZ4E_decompress_safe() - decompress a block from 'src' into 'dst'.
+ * The compressed size and the capacity of 'dst' are taken from 'srcIter'
+ * and 'dstIter', which are moved past the consumed and written bytes.
+ * Malformed input is detected and never makes the decoder access memory
+ * outside of the iterators.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+int LZ4E_decompress_safe(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter);
+
+/*
+ * LZ4E_decompress_safe_partial() - same as LZ4E_decompress_safe(), but
+ * stops once 'targetOutputSize' bytes are decompressed, so reading
+ * the beginning of a block does not require decoding all of it.
+ * Returns the number of decompressed bytes, which may be less than
+ * 'targetOutputSize' only if the block is shorter, or a negative value
+ * on error. 'srcIter' may not be at the end of the block afterwards.
+ */
+int LZ4E_decompress_safe_partial(const struct bio_vec *src,
+		struct bio_vec *dst, struct bvec_iter *srcIter,
+		struct bvec_iter *dstIter, int targetOutputSize);
+
+/*
+ * LZ4E_decompress_safe_partial_flat() - LZ4E_decompress_safe_partial()
+ * for contiguous buffers
+ */
+int LZ4E_decompress_safe_partial_flat(const char *source, char *dest,
+		int compressedSize, int targetOutputSize,
+		int maxDecompressedSize);
+
+/*
+ * LZ4E_decompress_safe_xxh32() - same as LZ4E_decompress_safe(), but also
+ * verifies the decoded data against '*checksum', an xxHash32 (seed 0) of
+ * the original input. The output is hashed as it is decoded. On mismatch
+ * a negative value is returned and the iterators are left untouched,
+ * though 'dst' is already overwritten. 'checksum' may be NULL.
+ */
+int LZ4E_decompress_safe_xxh32(const struct bio_vec *src,
+		struct bio_vec *dst, struct bvec_iter *srcIter,
+		struct bvec_iter *dstIter, const uint32_t *checksum);
+
+/*
+ * LZ4E_decompress_blocks() - decompress all blocks produced by
+ * LZ4E_compress_blocks(). 'srcIter' holds the whole compressed data.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+int LZ4E_decompress_blocks(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter);
+
+/*
+ * LZ4E_decompress_block() - decompress only the block 'blockIdx' of
+ * the data produced by LZ4E_compress_blocks(), which holds the input
+ * bytes starting from 'blockIdx * LZ4E_BLOCK_SIZE'. 'srcIter' holds
+ * the whole compressed data and is moved past the decoded block.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+int LZ4E_decompress_block(const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+		unsigned int blockIdx);
+
+/*
+ * LZ4E_streamDecode_t - information structure to track decompression
+ * of a stream produced by LZ4E_compress_fast_continue(). As with
+ * LZ4E_stream_t, the dictionary is kept as descriptors of the last 64KB
+ * of decompressed data, the data itself stays in place.
+ */
+#define LZ4E_STREAMDECODESIZE_U64	\
+	(LZ4E_SEGTAB_SIZE_U64 + LZ4E_DICTVECS_SIZE_U64 + 3)
+typedef struct {
+	LZ4E_segtab_t dictSegTable;
+	struct bio_vec dictVecs[LZ4E_SEG_MAX];
+	struct bvec_iter dictIter;
+} LZ4E_streamDecode_t_internal;
+typedef union {
+	unsigned long long table[LZ4E_STREAMDECODESIZE_U64];
+	LZ4E_streamDecode_t_internal internal_donotuse;
+} LZ4E_streamDecode_t;
+
+/*
+ * LZ4E_setStreamDecode() - start decoding a stream with the dictionary
+ * described by 'dictIter', which may be empty. The dictionary has to
+ * stay in place while it is in use.
+ */
+int LZ4E_setStreamDecode(LZ4E_streamDecode_t *streamDecode,
+		const struct bio_vec *dict, struct bvec_iter dictIter);
+
+/*
+ * LZ4E_decompress_safe_continue() - decompress the next block of a stream
+ * into 'dst'. The previous 64KB of decompressed data have to stay in place,
+ * but they do not need to precede 'dst': every call may decode into
+ * a different set of pages. Only the last LZ4E_SEG_MAX bvecs of them are
+ * kept, which are enough for 64KB of pages.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+int LZ4E_decompress_safe_continue(LZ4E_streamDecode_t *streamDecode,
+		const struct bio_vec *src, struct bio_vec *dst,
+		struct bvec_iter *srcIter, struct bvec_iter *dstIter);
+
+/*
+ * LZ4E_streamDecodeFlat_t - the same for decompression between
+ * flat buffers
+ */
+#define LZ4E_STREAMDECODEFLATSIZE_U64 4
+typedef struct {
+	const uint8_t *externalDict;
+	size_t extDictSize;
+	const uint8_t *prefixEnd;
+	size_t prefixSize;
+} LZ4E_streamDecodeFlat_t_internal;
+typedef union {
+	unsigned long long table[LZ4E_STREAMDECODEFLATSIZE_U64];
+	LZ4E_streamDecodeFlat_t_internal internal_donotuse;
+} LZ4E_streamDecodeFlat_t;
+
+/*
+ * LZ4E_setStreamDecode_flat() - start decoding a stream into flat buffers
+ * with the given dictionary, 'dictSize' may be 0
+ */
+int LZ4E_setStreamDecode_flat(LZ4E_streamDecodeFlat_t *streamDecode,
+		const char *dictionary, int dictSize);
+
+/*
+ * LZ4E_decompress_safe_continue_flat() - decompress the next block of
+ * a stream into a flat buffer. The previous 64KB of decompressed data have
+ * to stay in place: blocks are either decoded one after another into the
+ * same buffer, or into a new buffer right after a block of at least 64KB.
+ */
+int LZ4E_decompress_safe_continue_flat(LZ4E_streamDecodeFlat_t *streamDecode,
+		const char *source, char *dest, int compressedSize,
+		int maxOutputSize);
 
 #ifndef LZ4E_DISTANCE_MAX	/* history window size; can be user-defined at compile time */
 #define LZ4E_DISTANCE_MAX 65535	/* set to maximum value by default */
@@ -45,6 +45,7 @@
 #include <linux/minmax.h>
 #include <linux/string.h>	 /* memset, memcpy */
 #include <linux/unaligned.h>
+#include <linux/xxhash.h>
 
 #include "lz4e.h"
 
@@ -101,7 +102,18 @@ typedef uintptr_t uptrval;
 #define MB (1 << 20)
 #define GB (1U << 30)
 
+/* Checksums are fed with spans of at least this size, still in L1 cache */
+#define LZ4E_XXH_SPAN (2 * KB)
+
+#define LZ4_64Klimit ((64 * KB) + (MFLIMIT - 1))
+
 #define MAX_DISTANCE LZ4E_DISTANCE_MAX
+
+/*
+ * Shortest match offset with favorDecSpeed. Closer matches overlap
+ * the bytes being copied, which the decoder does a few bytes at a time.
+ */
+#define LZ4E_DEC_SPEED_OFFSET 8
 #define STEPSIZE sizeof(size_t)
 
 #define ML_BITS	4
@@ -112,9 +124,6 @@ typedef uintptr_t uptrval;
 /*-************************************
  *	Bvec iterator helpers
  **************************************/
-#define LZ4E_ITER_POS(iter, start) \
-	(((start).bi_size) - ((iter).bi_size))
-
 #define LZ4E_for_each_bvec(bvl, bio_vec, iter, start) \
 	for (iter = (start); \
 	     ((iter).bi_size) && \
@@ -168,34 +177,6 @@ static FORCE_INLINE void LZ4E_iter_rollback1(const struct bio_vec *bvecs,
 	iter->bi_size++;
 }
 
-static FORCE_INLINE void LZ4E_advance(
-	const struct bio_vec *bvecs,
-	struct bvec_iter *iter,
-	U32 *pos,
-	const unsigned bytes)
-{
-	bvec_iter_advance(bvecs, iter, bytes);
-	*pos += bytes;
-}
-
-static FORCE_INLINE void LZ4E_advance1(
-	const struct bio_vec *bvecs,
-	struct bvec_iter *iter,
-	U32 *pos)
-{
-	LZ4E_iter_advance1(bvecs, iter);
-	(*pos)++;
-}
-
-static FORCE_INLINE void LZ4E_rollback1(
-	const struct bio_vec *bvecs,
-	struct bvec_iter *iter,
-	U32 *pos)
-{
-	LZ4E_iter_rollback1(bvecs, iter);
-	(*pos)--;
-}
-
 /*-************************************
  *	Reading and writing into memory
  **************************************/
@@ -401,292 +382,713 @@ static FORCE_INLINE void LZ4E_memcpy_to_sg(struct bio_vec *to, const char *from,
 	}
 }
 
+/*-************************************
+ *	Mapped segment cursor
+ **************************************/
+/*
+ * LZ4E_cursor_t - position inside of a scatter-gather buffer.
+ * Besides the bvec iterator it caches the address of the current byte
+ * and the number of bytes left in the mapped segment, so that accesses
+ * within the segment do not have to go through the page helpers.
+ *
+ * Lowmem pages are always mapped, and physically contiguous pages of a
+ * multi-page bvec are contiguous in the linear mapping, so the whole
+ * remaining bvec is exposed at once. With CONFIG_HIGHMEM only the current
+ * page is exposed, and highmem pages are not mapped at all ('left' is 0),
+ * making every access take the copying path.
+ */
+typedef struct {
+	struct bvec_iter iter;
+	BYTE *ptr;		/* address of the current byte */
+	unsigned int left;	/* bytes accessible through 'ptr' */
+	unsigned int off;	/* bytes accessible before 'ptr' */
+} LZ4E_cursor_t;
+
+static FORCE_INLINE void LZ4E_cur_map(const struct bio_vec *bvecs,
+		LZ4E_cursor_t *cur)
+{
+	struct bio_vec bv;
+
+	cur->ptr = NULL;
+	cur->left = 0;
+	cur->off = 0;
+
+	if (unlikely(!cur->iter.bi_size))
+		return;
+
+#ifdef CONFIG_HIGHMEM
+	bv = bvec_iter_bvec(bvecs, cur->iter);
+
+	if (PageHighMem(bv.bv_page))
+		return;
+#else
+	bv = mp_bvec_iter_bvec(bvecs, cur->iter);
+	cur->off = cur->iter.bi_bvec_done;
+#endif
+
+	cur->ptr = (BYTE *)page_address(bv.bv_page) + bv.bv_offset;
+	cur->left = bv.bv_len;
+}
+
+static FORCE_INLINE LZ4E_cursor_t LZ4E_cur_init(const struct bio_vec *bvecs,
+		const struct bvec_iter iter)
+{
+	LZ4E_cursor_t cur = { .iter = iter };
+
+	LZ4E_cur_map(bvecs, &cur);
+	return cur;
+}
+
+/*
+ * cursor at the given address within the mapped segment of another one
+ */
+static FORCE_INLINE LZ4E_cursor_t LZ4E_cur_at(const LZ4E_cursor_t *cur,
+		const BYTE *ptr)
+{
+	LZ4E_cursor_t ret = *cur;
+	const ptrdiff_t delta = ptr - cur->ptr;
+
+	ret.ptr = (BYTE *)ptr;
+	ret.left -= delta;
+	ret.off += delta;
+	ret.iter.bi_bvec_done += delta;
+	ret.iter.bi_size -= delta;
+	return ret;
+}
+
+/*
+ * advance cursor by given number of bytes,
+ * remapping only when leaving the current segment
+ */
+static FORCE_INLINE void LZ4E_cur_advance(const struct bio_vec *bvecs,
+		LZ4E_cursor_t *cur, const unsigned int bytes)
+{
+	if (likely(bytes < cur->left)) {
+		cur->ptr += bytes;
+		cur->left -= bytes;
+		cur->off += bytes;
+		cur->iter.bi_bvec_done += bytes;
+		cur->iter.bi_size -= bytes;
+		return;
+	}
+
+	bvec_iter_advance(bvecs, &cur->iter, bytes);
+	LZ4E_cur_map(bvecs, cur);
+}
+
+/*
+ * roll cursor back by exactly 1 byte
+ */
+static FORCE_INLINE void LZ4E_cur_rollback1(const struct bio_vec *bvecs,
+		LZ4E_cursor_t *cur)
+{
+	if (likely(cur->off)) {
+		cur->ptr--;
+		cur->left++;
+		cur->off--;
+		cur->iter.bi_bvec_done--;
+		cur->iter.bi_size++;
+		return;
+	}
+
+	LZ4E_iter_rollback1(bvecs, &cur->iter);
+	LZ4E_cur_map(bvecs, cur);
+}
+
+/*
+ * cursor the given number of bytes before another one,
+ * the bytes must lie within the buffer
+ */
+static FORCE_INLINE LZ4E_cursor_t LZ4E_cur_back(const struct bio_vec *bvecs,
+		const LZ4E_cursor_t *cur, unsigned int bytes)
+{
+	struct bvec_iter iter = cur->iter;
+
+	if (likely(bytes <= cur->off))
+		return LZ4E_cur_at(cur, cur->ptr - bytes);
+
+	iter.bi_size += bytes;
+
+	while (bytes > iter.bi_bvec_done) {
+		bytes -= iter.bi_bvec_done;
+
+		BUG_ON(iter.bi_idx == 0);
+
+		iter.bi_idx--;
+		iter.bi_bvec_done = bvecs[iter.bi_idx].bv_len;
+	}
+
+	iter.bi_bvec_done -= bytes;
+	return LZ4E_cur_init(bvecs, iter);
+}
+
+static FORCE_INLINE void LZ4E_advance(
+	const struct bio_vec *bvecs,
+	LZ4E_cursor_t *cur,
+	U32 *pos,
+	const unsigned bytes)
+{
+	LZ4E_cur_advance(bvecs, cur, bytes);
+	*pos += bytes;
+}
+
+static FORCE_INLINE void LZ4E_advance1(
+	const struct bio_vec *bvecs,
+	LZ4E_cursor_t *cur,
+	U32 *pos)
+{
+	LZ4E_cur_advance(bvecs, cur, 1);
+	(*pos)++;
+}
+
+static FORCE_INLINE void LZ4E_rollback1(
+	const struct bio_vec *bvecs,
+	LZ4E_cursor_t *cur,
+	U32 *pos)
+{
+	LZ4E_cur_rollback1(bvecs, cur);
+	(*pos)--;
+}
+
+/*
+ * Copy through the mapped segment if possible,
+ * otherwise the access straddles segments and is done by parts
+ */
+static FORCE_INLINE void LZ4E_memcpy_from_cur(void *to,
+		const struct bio_vec *from, const LZ4E_cursor_t *cur, size_t len)
+{
+	if (likely(len <= cur->left)) {
+		LZ4_memcpy(to, cur->ptr, len);
+		return;
+	}
+
+	LZ4E_memcpy_from_sg(to, from, cur->iter, len);
+}
+
+static FORCE_INLINE void LZ4E_memcpy_to_cur(struct bio_vec *to,
+		const void *from, const LZ4E_cursor_t *cur, size_t len)
+{
+	if (likely(len <= cur->left)) {
+		LZ4_memcpy(cur->ptr, from, len);
+		return;
+	}
+
+	LZ4E_memcpy_to_sg(to, from, cur->iter, len);
+}
+
 static FORCE_INLINE BYTE LZ4E_read8(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	BYTE ret;
 
-	LZ4E_memcpy_from_sg(&ret, from, iter, 1);
+	if (likely(cur->left))
+		return *cur->ptr;
+
+	LZ4E_memcpy_from_sg((char *)&ret, from, cur->iter, 1);
 	return ret;
 }
 
 static FORCE_INLINE void LZ4E_write8(struct bio_vec *to, const BYTE value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
-	LZ4E_memcpy_to_sg(to, &value, iter, 1);
+	if (likely(cur->left)) {
+		*cur->ptr = value;
+		return;
+	}
+
+	LZ4E_memcpy_to_sg(to, (const char *)&value, cur->iter, 1);
 }
 
 static FORCE_INLINE U16 LZ4E_read16(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	U16 ret;
 
-	LZ4E_memcpy_from_sg((char *)(&ret), from, iter, 2);
+	LZ4E_memcpy_from_cur(&ret, from, cur, 2);
 	return ret;
 }
 
 static FORCE_INLINE void LZ4E_write16(struct bio_vec *to, const U16 value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
-	LZ4E_memcpy_to_sg(to, (char *)(&value), iter, 2);
+	LZ4E_memcpy_to_cur(to, &value, cur, 2);
 }
 
 static FORCE_INLINE U16 LZ4E_readLE16(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	U16 ret;
 
-	LZ4E_memcpy_from_sg((char *)(&ret), from, iter, 2);
+	LZ4E_memcpy_from_cur(&ret, from, cur, 2);
 	return LZ4E_toLE16(ret);
 }
 
 static FORCE_INLINE void LZ4E_writeLE16(struct bio_vec *to, const U16 value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	U16 valueLE = LZ4E_toLE16(value);
 
-	LZ4E_memcpy_to_sg(to, (char *)(&valueLE), iter, 2);
+	LZ4E_memcpy_to_cur(to, &valueLE, cur, 2);
 }
 
 static FORCE_INLINE U32 LZ4E_read32(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	U32 ret;
 
-	LZ4E_memcpy_from_sg((char *)(&ret), from, iter, 4);
+	LZ4E_memcpy_from_cur(&ret, from, cur, 4);
 	return ret;
 }
 
 static FORCE_INLINE void LZ4E_write32(struct bio_vec *to, const U32 value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
-	LZ4E_memcpy_to_sg(to, (char *)(&value), iter, 4);
+	LZ4E_memcpy_to_cur(to, &value, cur, 4);
 }
 
 static FORCE_INLINE U64 LZ4E_read64(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 	U64 ret;
 
-	LZ4E_memcpy_from_sg((char *)(&ret), from, iter, 8);
+	LZ4E_memcpy_from_cur(&ret, from, cur, 8);
 	return ret;
 }
 
 static FORCE_INLINE void LZ4E_write64(struct bio_vec *to, const U64 value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
-	LZ4E_memcpy_to_sg(to, (char *)(&value), iter, 8);
+	LZ4E_memcpy_to_cur(to, &value, cur, 8);
 }
 
 static FORCE_INLINE size_t LZ4E_readArch(const struct bio_vec *from,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 #if LZ4_ARCH64
-	return (size_t)LZ4E_read64(from, iter);
+	return (size_t)LZ4E_read64(from, cur);
 #else
-	return (size_t)LZ4E_read32(from, iter);
+	return (size_t)LZ4E_read32(from, cur);
 #endif
 }
 
 static FORCE_INLINE void LZ4E_writeArch(struct bio_vec *to, const size_t value,
-		struct bvec_iter iter)
+		const LZ4E_cursor_t *cur)
 {
 #if LZ4_ARCH64
-	LZ4E_write64(to, (U64)value, iter);
+	LZ4E_write64(to, (U64)value, cur);
 #else
-	LZ4E_write32(to, (U32)value, iter);
+	LZ4E_write32(to, (U32)value, cur);
 #endif
 }
 
 static FORCE_INLINE void LZ4E_copy8(struct bio_vec *dst, const struct bio_vec *src,
-		struct bvec_iter dstIter, struct bvec_iter srcIter)
+		const LZ4E_cursor_t *dstCur, const LZ4E_cursor_t *srcCur)
 {
-	BYTE val = LZ4E_read8(src, srcIter);
+	BYTE val = LZ4E_read8(src, srcCur);
 
-	LZ4E_write8(dst, val, dstIter);
+	LZ4E_write8(dst, val, dstCur);
 }
 
 static FORCE_INLINE void LZ4E_copy16(struct bio_vec *dst, const struct bio_vec *src,
-		struct bvec_iter dstIter, struct bvec_iter srcIter)
+		const LZ4E_cursor_t *dstCur, const LZ4E_cursor_t *srcCur)
 {
-	U16 val = LZ4E_read16(src, srcIter);
+	U16 val = LZ4E_read16(src, srcCur);
 
-	LZ4E_write16(dst, val, dstIter);
+	LZ4E_write16(dst, val, dstCur);
 }
 
 static FORCE_INLINE void LZ4E_copy32(struct bio_vec *dst, const struct bio_vec *src,
-		struct bvec_iter dstIter, struct bvec_iter srcIter)
+		const LZ4E_cursor_t *dstCur, const LZ4E_cursor_t *srcCur)
 {
-	U32 val = LZ4E_read32(src, srcIter);
+	U32 val = LZ4E_read32(src, srcCur);
 
-	LZ4E_write32(dst, val, dstIter);
+	LZ4E_write32(dst, val, dstCur);
 }
 
 static FORCE_INLINE void LZ4E_copy64(struct bio_vec *dst, const struct bio_vec *src,
-		struct bvec_iter dstIter, struct bvec_iter srcIter)
+		const LZ4E_cursor_t *dstCur, const LZ4E_cursor_t *srcCur)
 {
-#if LZ4_ARCH64
-	U64 val = LZ4E_read64(src, srcIter);
-
-	LZ4E_write64(dst, val, dstIter);
-#else
-	U32 a = LZ4E_read32(src, srcIter);
-	bvec_iter_advance(src, &srcIter, 4)
-	U32 b = LZ4E_read32(src, srcIter);
+	U64 val = LZ4E_read64(src, srcCur);
 
-	LZ4E_write32(dst, a, dstIter);
-	bvec_iter_advance(dst, &dstIter, 4);
-	LZ4E_write32(dst, b, dstIter);
-#endif
+	LZ4E_write64(dst, val, dstCur);
 }
 
 /*
- * customized variant of memcpy,
- * which can overwrite up to 7 bytes beyond target len
+ * copy as maximal spans that lie within the mapped segments of both
+ * cursors, one memcpy per span. Unmapped segments are copied through
+ * the helpers by words. The buffers must not overlap.
  */
-static FORCE_INLINE void LZ4E_wildCopy(struct bio_vec *dst, const struct bio_vec *src,
-	struct bvec_iter dstIter, struct bvec_iter srcIter, size_t len)
+static FORCE_INLINE void LZ4E_memcpy(struct bio_vec *dst, const struct bio_vec *src,
+	LZ4E_cursor_t dstCur, LZ4E_cursor_t srcCur, size_t len)
 {
 	while (len) {
-		LZ4E_copy64(dst, src, dstIter, srcIter);
-		bvec_iter_advance(src, &srcIter, WILDCOPYLENGTH);
-		bvec_iter_advance(dst, &dstIter, WILDCOPYLENGTH);
-		len -= min_t(size_t, len, WILDCOPYLENGTH);
+		size_t span = min_t(size_t, len,
+			min_t(unsigned int, dstCur.left, srcCur.left));
+
+		if (likely(span)) {
+			memcpy(dstCur.ptr, srcCur.ptr, span);
+		} else {
+			BYTE buf[8];
+
+			span = min_t(size_t, len, sizeof(buf));
+			LZ4E_memcpy_from_cur(buf, src, &srcCur, span);
+			LZ4E_memcpy_to_cur(dst, buf, &dstCur, span);
+		}
+
+		len -= span;
+
+		if (!len)
+			break;
+
+		LZ4E_cur_advance(src, &srcCur, span);
+		LZ4E_cur_advance(dst, &dstCur, span);
 	}
 }
 
-static FORCE_INLINE void LZ4E_memcpy(struct bio_vec *dst, const struct bio_vec *src,
-	struct bvec_iter dstIter, struct bvec_iter srcIter, size_t len)
+/*
+ * feed 'len' bytes at the cursor into the checksum, one mapped segment
+ * at a time. Unmapped segments are fed through the helpers by words.
+ */
+static FORCE_INLINE void LZ4E_xxh32_update(struct xxh32_state *state,
+	const struct bio_vec *bvecs, LZ4E_cursor_t cur, size_t len)
 {
-	for (int i = 0; i < len / 8; ++i) {
-		LZ4E_copy64(dst, src, dstIter, srcIter);
-		bvec_iter_advance(src, &srcIter, 8);
-		bvec_iter_advance(dst, &dstIter, 8);
-	}
+	while (len) {
+		size_t span = min_t(size_t, len, cur.left);
+
+		if (likely(span)) {
+			xxh32_update(state, cur.ptr, span);
+		} else {
+			BYTE buf[8];
+
+			span = min_t(size_t, len, sizeof(buf));
+			LZ4E_memcpy_from_cur(buf, bvecs, &cur, span);
+			xxh32_update(state, buf, span);
+		}
+
+		len -= span;
 
-	len %= 8;
+		if (!len)
+			break;
 
-	if (len >= 4) {
-		LZ4E_copy32(dst, src, dstIter, srcIter);
-		bvec_iter_advance(src, &srcIter, 4);
-		bvec_iter_advance(dst, &dstIter, 4);
-		len -= 4;
+		LZ4E_cur_advance(bvecs, &cur, span);
 	}
+}
 
-	if (len >= 2) {
-		LZ4E_copy16(dst, src, dstIter, srcIter);
-		bvec_iter_advance(src, &srcIter, 2);
-		bvec_iter_advance(dst, &dstIter, 2);
-		len -= 2;
+/*
+ * customized variant of memcpy,
+ * which can overwrite up to 7 bytes beyond target len
+ * within the mapped segment of 'dstCur'
+ */
+static FORCE_INLINE void LZ4E_wildCopy(struct bio_vec *dst, const struct bio_vec *src,
+	LZ4E_cursor_t dstCur, LZ4E_cursor_t srcCur, size_t len)
+{
+	/* Short literal runs take a single word move */
+	if (likely(len <= WILDCOPYLENGTH && dstCur.left >= WILDCOPYLENGTH
+			&& srcCur.left >= WILDCOPYLENGTH)) {
+		LZ4_copy8(dstCur.ptr, srcCur.ptr);
+		return;
 	}
 
-	if (len)
-		LZ4E_copy8(dst, src, dstIter, srcIter);
+	LZ4E_memcpy(dst, src, dstCur, srcCur, len);
 }
 
+/*
+ * count matching bytes, the match may lie in another buffer than the input.
+ * Words are compared in place for as long as both cursors stay within
+ * their mapped segments, only the words straddling a segment edge
+ * are read through the copying helpers.
+ */
 static FORCE_INLINE unsigned LZ4E_count(
-	const struct bio_vec *bvecs,
-	struct bvec_iter inIter,
-	struct bvec_iter matchIter,
+	const struct bio_vec *inBvecs,
+	LZ4E_cursor_t inCur,
+	const struct bio_vec *matchBvecs,
+	LZ4E_cursor_t matchCur,
 	const unsigned countLimit)
 {
 	unsigned count = 0;
 
-	for (int i = 0; i < countLimit / STEPSIZE; ++i) {
-		size_t const inVal = LZ4E_readArch(bvecs, inIter);
-		size_t const matchVal = LZ4E_readArch(bvecs, matchIter);
-		size_t const diff = inVal ^ matchVal;
+	/* Most matches end within the first word */
+	if (likely(countLimit >= STEPSIZE)) {
+		size_t const diff = LZ4E_readArch(inBvecs, &inCur)
+			^ LZ4E_readArch(matchBvecs, &matchCur);
+
+		if (diff)
+			return LZ4_NbCommonBytes(diff);
+
+		count = STEPSIZE;
+		LZ4E_cur_advance(inBvecs, &inCur, STEPSIZE);
+		LZ4E_cur_advance(matchBvecs, &matchCur, STEPSIZE);
+	}
 
-		if (diff) {
-			count += LZ4_NbCommonBytes(diff);
-			return count;
+	while (count < countLimit) {
+		const unsigned left = countLimit - count;
+		const unsigned span = min_t(unsigned, left,
+			min_t(unsigned, inCur.left, matchCur.left));
+
+		if (likely(span >= STEPSIZE)) {
+			const unsigned matched = LZ4_count(inCur.ptr,
+				matchCur.ptr, inCur.ptr + span);
+
+			count += matched;
+
+			if (matched < span)
+				return count;
+
+			LZ4E_cur_advance(inBvecs, &inCur, span);
+			LZ4E_cur_advance(matchBvecs, &matchCur, span);
+			continue;
 		}
 
-		count += STEPSIZE;
+		if (left >= STEPSIZE) {
+			size_t const inVal = LZ4E_readArch(inBvecs, &inCur);
+			size_t const matchVal = LZ4E_readArch(matchBvecs, &matchCur);
+			size_t const diff = inVal ^ matchVal;
 
-		bvec_iter_advance(bvecs, &inIter, STEPSIZE);
-		bvec_iter_advance(bvecs, &matchIter, STEPSIZE);
-	}
+			if (diff)
+				return count + LZ4_NbCommonBytes(diff);
 
-	unsigned rem = countLimit % STEPSIZE;
+			count += STEPSIZE;
+
+			LZ4E_cur_advance(inBvecs, &inCur, STEPSIZE);
+			LZ4E_cur_advance(matchBvecs, &matchCur, STEPSIZE);
+			continue;
+		}
 
 #if LZ4_ARCH64
-	if (rem >= 4 && LZ4E_read32(bvecs, inIter)
-			== LZ4E_read32(bvecs, matchIter)) {
-		count += 4;
-		rem -= 4;
-		bvec_iter_advance(bvecs, &inIter, 4);
-		bvec_iter_advance(bvecs, &matchIter, 4);
-	}
+		if (left >= 4 && LZ4E_read32(inBvecs, &inCur)
+				== LZ4E_read32(matchBvecs, &matchCur)) {
+			count += 4;
+			LZ4E_cur_advance(inBvecs, &inCur, 4);
+			LZ4E_cur_advance(matchBvecs, &matchCur, 4);
+		}
 #endif
 
-	if (rem >= 2 && LZ4E_read16(bvecs, inIter)
-			== LZ4E_read16(bvecs, matchIter)) {
-		count += 2;
-		rem -= 2;
-		bvec_iter_advance(bvecs, &inIter, 2);
-		bvec_iter_advance(bvecs, &matchIter, 2);
-	}
+		if (countLimit - count >= 2 && LZ4E_read16(inBvecs, &inCur)
+				== LZ4E_read16(matchBvecs, &matchCur)) {
+			count += 2;
+			LZ4E_cur_advance(inBvecs, &inCur, 2);
+			LZ4E_cur_advance(matchBvecs, &matchCur, 2);
+		}
+
+		if (countLimit - count >= 1 && LZ4E_read8(inBvecs, &inCur)
+				== LZ4E_read8(matchBvecs, &matchCur))
+			count++;
 
-	if (rem && LZ4E_read8(bvecs, inIter)
-			== LZ4E_read8(bvecs, matchIter))
-		count++;
+		break;
+	}
 
 	return count;
 }
 
 /*-************************************
- *	Hash table addresses
+ *	Segment table
  **************************************/
-typedef union {
-	struct {
-		/* Max 16 bvecs by 4 kilobytes */
-		BYTE bvec_idx : 4;
-		U16 bvec_off  : 12;
-	} addr;
-	U16 raw;
-} __packed LZ4E_tbl_addr16_t;
-
-typedef union {
-	struct {
-		/* Max 256 bvecs by 16 megabytes */
-		BYTE bvec_idx : 8;
-		U32 bvec_off  : 24;
-	} addr;
-	U32 raw;
-} __packed LZ4E_tbl_addr32_t;
-
-typedef union {
-	struct {
-		/* Max 256 bvecs of maximum size */
-		BYTE bvec_idx : 8;
-		U32 bvec_off  : 32;
-		/* 24 bytes reserved */
-	} addr;
-	U64 raw;
-} __packed LZ4E_tbl_addr64_t;
-
-#define LZ4E_TBL_ADDR16_IDX_LIMIT (1 << 4)
-#define LZ4E_TBL_ADDR16_OFF_LIMIT (1 << 12)
-#define LZ4E_TBL_ADDR32_OFF_LIMIT (1 << 24)
-
-#define LZ4E_TBL_ADDR_FROM_ITER(addrType, iter, baseIter) \
-	((addrType) { \
-		.addr = { \
-			.bvec_idx = (((iter).bi_idx) - ((baseIter).bi_idx)), \
-			.bvec_off = ((iter).bi_bvec_done) \
-		} \
-	})
-
-#define LZ4E_TBL_ADDR_TO_ITER(addr, baseIter, bvIterSize) \
-	((struct bvec_iter) { \
-		.bi_idx = (((addr).addr.bvec_idx) + ((baseIter).bi_idx)), \
-		.bi_size = (((bvIterSize)[(addr).addr.bvec_idx]) - ((addr).addr.bvec_off)), \
-		.bi_bvec_done = ((addr).addr.bvec_off) \
-	 })
-
-typedef enum { noLimit = 0, limitedOutput = 1 } limitedOutput_directive;
-typedef enum { byU16 = 1, byU32 = 3, byU64 = 7 } tableType_t;
+/*
+ * translate input position into an iterator
+ */
+static FORCE_INLINE struct bvec_iter LZ4E_seg_iter(
+		const LZ4E_segtab_t *segTable, const struct bvec_iter start,
+		const U32 pos)
+{
+	const U32 virt = pos + segTable->lead;
+	U32 i;
+
+	/* Segments of whole pages are found by shift and mask */
+	if (segTable->pages)
+		return (struct bvec_iter) {
+			.bi_idx = start.bi_idx + (virt >> PAGE_SHIFT),
+			.bi_size = start.bi_size - pos,
+			.bi_bvec_done = virt & ~PAGE_MASK
+		};
+
+	i = segTable->lut[virt >> segTable->shift];
+
+	/* Granule may contain the start of the next segment */
+	while (virt >= segTable->start[i + 1])
+		i++;
+
+	return (struct bvec_iter) {
+		.bi_idx = start.bi_idx + i,
+		.bi_size = start.bi_size - pos,
+		.bi_bvec_done = virt - segTable->start[i]
+	};
+}
+
+/*
+ * Get cursor at the given input position. If the position falls into
+ * the mapped segment of 'near', its mapping is reused, otherwise the
+ * position is translated through the segment table.
+ */
+static FORCE_INLINE LZ4E_cursor_t LZ4E_getCursorNear(
+	const struct bio_vec *bvecs,
+	const U32 pos,
+	const LZ4E_segtab_t *segTable,
+	const struct bvec_iter baseIter,
+	const LZ4E_cursor_t *near,
+	const U32 nearPos)
+{
+	const ptrdiff_t delta = (ptrdiff_t)pos - (ptrdiff_t)nearPos;
+
+	if (delta >= -(ptrdiff_t)near->off && delta < (ptrdiff_t)near->left)
+		return LZ4E_cur_at(near, near->ptr + delta);
+
+	return LZ4E_cur_init(bvecs, LZ4E_seg_iter(segTable, baseIter, pos));
+}
+
+/*
+ * fill positions of source bvecs,
+ * fails if there are more than LZ4E_SEG_MAX of them
+ */
+static inline bool LZ4E_fillSegTable(
+	LZ4E_segtab_t *segTable,
+	const struct bio_vec *bvecs,
+	const struct bvec_iter start)
+{
+	const U32 total = start.bi_bvec_done + start.bi_size;
+	struct bvec_iter iter = start;
+	unsigned int i = 0;
+	unsigned int g;
+	bool pages = true;
+
+	while (iter.bi_size) {
+		const struct bio_vec *bvec = &bvecs[iter.bi_idx];
+
+		if (i >= LZ4E_SEG_MAX)
+			return false;
+
+		/* Only the last bvec may be a partial page */
+		if (bvec->bv_offset || bvec->bv_len > PAGE_SIZE
+			|| (bvec->bv_len < PAGE_SIZE
+				&& bvec->bv_len - iter.bi_bvec_done
+					< iter.bi_size))
+			pages = false;
+
+		/* Position of the first byte of the bvec */
+		segTable->start[i++] = total - iter.bi_size - iter.bi_bvec_done;
+		bvec_iter_advance_single(bvecs, &iter,
+			mp_bvec_iter_len(bvecs, iter));
+	}
+
+	segTable->start[i] = total;
+	segTable->lead = start.bi_bvec_done;
+	segTable->pages = pages;
+
+	/* Page bios, as most of them are, need no lookup table */
+	if (pages)
+		return true;
+
+	segTable->shift = max(fls(total - 1) - LZ4E_SEG_LUT_LOG, 0);
+
+	for (g = 0, i = 0; g <= ((total - 1) >> segTable->shift); g++) {
+		while ((g << segTable->shift) >= segTable->start[i + 1])
+			i++;
+
+		segTable->lut[g] = (U16)i;
+	}
+
+	return true;
+}
+
+/*-************************************
+ *	Dictionary descriptors
+ **************************************/
+/*
+ * copy descriptors of the bvec segments covered by 'iter' into 'to',
+ * 'to' may be the same array as 'from' as long as it does not run ahead
+ */
+static inline unsigned int LZ4E_copyVecs(struct bio_vec *to,
+	const struct bio_vec *from, struct bvec_iter iter)
+{
+	unsigned int n = 0;
+
+	while (iter.bi_size) {
+		const struct bio_vec bv = mp_bvec_iter_bvec(from, iter);
+
+		bvec_iter_advance_single(from, &iter, bv.bv_len);
+		to[n++] = bv;
+	}
+
+	return n;
+}
+
+static inline unsigned int LZ4E_countVecs(const struct bio_vec *bvecs,
+	struct bvec_iter iter)
+{
+	unsigned int n = 0;
+
+	while (iter.bi_size) {
+		bvec_iter_advance_single(bvecs, &iter,
+			mp_bvec_iter_len(bvecs, iter));
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * drop leading segments of 'iter' until at most 'maxVecs' are left
+ */
+static inline void LZ4E_trimVecs(const struct bio_vec *bvecs,
+	struct bvec_iter *iter, unsigned int maxVecs)
+{
+	unsigned int n = LZ4E_countVecs(bvecs, *iter);
+
+	for (; n > maxVecs; n--)
+		bvec_iter_advance_single(bvecs, iter,
+			mp_bvec_iter_len(bvecs, *iter));
+}
+
+/*
+ * make the last 64KB of the dictionary described by 'dictVecs'
+ * followed by 'srcIter' the new dictionary
+ */
+static inline void LZ4E_appendVecs(
+	struct bio_vec *dictVecs,
+	struct bvec_iter *dictIterPtr,
+	LZ4E_segtab_t *dictSegTable,
+	const struct bio_vec *src,
+	struct bvec_iter srcIter)
+{
+	struct bvec_iter dictIter = *dictIterPtr;
+	unsigned int n = 0;
+
+	if (srcIter.bi_size >= 64 * KB) {
+		bvec_iter_advance(src, &srcIter, srcIter.bi_size - 64 * KB);
+		dictIter.bi_size = 0;
+	} else if (dictIter.bi_size + srcIter.bi_size > 64 * KB) {
+		bvec_iter_advance(dictVecs, &dictIter,
+			dictIter.bi_size + srcIter.bi_size - 64 * KB);
+	}
+
+	LZ4E_trimVecs(src, &srcIter, LZ4E_SEG_MAX);
+	LZ4E_trimVecs(dictVecs, &dictIter,
+		LZ4E_SEG_MAX - LZ4E_countVecs(src, srcIter));
+
+	n = LZ4E_copyVecs(dictVecs, dictVecs, dictIter);
+	n += LZ4E_copyVecs(dictVecs + n, src, srcIter);
+
+	*dictIterPtr = (struct bvec_iter) {
+		.bi_size = dictIter.bi_size + srcIter.bi_size,
+	};
+
+	if (n)
+		LZ4E_fillSegTable(dictSegTable, dictVecs, *dictIterPtr);
+}
+
+typedef enum {
+	noLimit = 0,
+	limitedOutput = 1,
+	fillOutput = 2
+} limitedOutput_directive;
+typedef enum { clearedTable = 0, byU32, byU16, byU16Page } tableType_t;
+
+/*
+ * hash log for inputs of up to 4KB, the part of the table they use
+ * stays small enough to remain in L1 cache between calls. It does not
+ * follow PAGE_SIZE: with 64KB pages it would not fit into the table.
+ */
+#define LZ4E_PAGE_INPUT_MAX (4 * KB)
+#define LZ4E_PAGE_HASHLOG (12 - 1)
 
 typedef enum { noDict = 0, withPrefix64k, usingExtDict } dict_directive;
 typedef enum { noDictIssue = 0, dictSmall } dictIssue_directive;
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * Crypto API glue: registers "lz4e" as an asynchronous compression
+ * algorithm. Scatterlists of the requests are turned into bvec arrays,
+ * which only describe the same pages, so the data is compressed and
+ * decompressed in place without being linearized.
+ */
+
+#include <crypto/internal/acompress.h>
+#include <linux/bvec.h>
+#include <linux/errno.h>
+#include <linux/minmax.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+
+#include "include/lz4e.h"
+
+/*
+ * Per-stream context: working memory and bvec arrays for both sides
+ */
+struct lz4e_acomp_ctx {
+	LZ4E_stream_t stream;
+	struct bio_vec src[LZ4E_SEG_MAX];
+	struct bio_vec dst[LZ4E_SEG_MAX];
+};
+
+static void *lz4e_acomp_alloc_ctx(void)
+{
+	/* Working memory has to be zeroed before the first use */
+	struct lz4e_acomp_ctx *ctx = kvzalloc(sizeof(*ctx), GFP_KERNEL);
+
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	return ctx;
+}
+
+static void lz4e_acomp_free_ctx(void *ctx)
+{
+	kvfree(ctx);
+}
+
+static struct crypto_acomp_streams lz4e_acomp_streams = {
+	.alloc_ctx = lz4e_acomp_alloc_ctx,
+	.free_ctx = lz4e_acomp_free_ctx,
+};
+
+/*
+ * Describe the first 'len' bytes of a scatterlist as bvecs. Entries are
+ * taken as they are, multi-page ones included, since the bvec iterators
+ * split them into pages on their own.
+ */
+static int lz4e_acomp_sg_to_bvecs(struct scatterlist *sg, unsigned int len,
+	struct bio_vec *bvecs, struct bvec_iter *iter)
+{
+	unsigned int count = 0;
+
+	*iter = (struct bvec_iter){ .bi_size = len };
+
+	for (; sg && len; sg = sg_next(sg)) {
+		const unsigned int segLen = min(sg->length, len);
+
+		if (!segLen)
+			continue;
+
+		if (count == LZ4E_SEG_MAX)
+			return -E2BIG;
+
+		bvec_set_page(&bvecs[count++], sg_page(sg), segLen,
+			sg->offset);
+		len -= segLen;
+	}
+
+	/* The scatterlist is shorter than the request says */
+	if (len)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int lz4e_acomp_compress(struct acomp_req *req)
+{
+	struct crypto_acomp_stream *s;
+	struct lz4e_acomp_ctx *ctx;
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	s = crypto_acomp_lock_stream_bh(&lz4e_acomp_streams);
+	ctx = s->ctx;
+
+	ret = lz4e_acomp_sg_to_bvecs(req->src, req->slen, ctx->src, &srcIter);
+	if (ret)
+		goto unlock;
+
+	ret = lz4e_acomp_sg_to_bvecs(req->dst, req->dlen, ctx->dst, &dstIter);
+	if (ret)
+		goto unlock;
+
+	ret = LZ4E_compress_default(ctx->src, ctx->dst, &srcIter, &dstIter,
+		&ctx->stream);
+	if (!ret) {
+		ret = -ENOSPC;
+		goto unlock;
+	}
+
+	req->dlen = ret;
+	ret = 0;
+
+unlock:
+	crypto_acomp_unlock_stream_bh(s);
+	return ret;
+}
+
+static int lz4e_acomp_decompress(struct acomp_req *req)
+{
+	struct crypto_acomp_stream *s;
+	struct lz4e_acomp_ctx *ctx;
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	/* Decompression needs no working memory, only the bvec arrays */
+	s = crypto_acomp_lock_stream_bh(&lz4e_acomp_streams);
+	ctx = s->ctx;
+
+	ret = lz4e_acomp_sg_to_bvecs(req->src, req->slen, ctx->src, &srcIter);
+	if (ret)
+		goto unlock;
+
+	ret = lz4e_acomp_sg_to_bvecs(req->dst, req->dlen, ctx->dst, &dstIter);
+	if (ret)
+		goto unlock;
+
+	ret = LZ4E_decompress_safe(ctx->src, ctx->dst, &srcIter, &dstIter);
+	if (ret < 0) {
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	req->dlen = ret;
+	ret = 0;
+
+unlock:
+	crypto_acomp_unlock_stream_bh(s);
+	return ret;
+}
+
+static struct acomp_alg lz4e_acomp = {
+	.compress = lz4e_acomp_compress,
+	.decompress = lz4e_acomp_decompress,
+	.base = {
+		.cra_name = "lz4e",
+		.cra_driver_name = "lz4e-generic",
+		.cra_module = THIS_MODULE,
+	},
+};
+
+static int __init lz4e_acomp_init(void)
+{
+	int ret;
+
+	ret = crypto_acomp_alloc_streams(&lz4e_acomp_streams);
+	if (ret)
+		return ret;
+
+	ret = crypto_register_acomp(&lz4e_acomp);
+	if (ret)
+		crypto_acomp_free_streams(&lz4e_acomp_streams);
+
+	return ret;
+}
+
+static void __exit lz4e_acomp_exit(void)
+{
+	crypto_unregister_acomp(&lz4e_acomp);
+	crypto_acomp_free_streams(&lz4e_acomp_streams);
+}
+
+module_init(lz4e_acomp_init);
+module_exit(lz4e_acomp_exit);
+
+MODULE_AUTHOR("Alexander Bugaev");
+MODULE_DESCRIPTION("LZ4 for scatter-gather buffers as a crypto acomp algorithm");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_CRYPTO("lz4e");
+MODULE_ALIAS_CRYPTO("lz4e-generic");
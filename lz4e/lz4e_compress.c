@@ -47,13 +47,13 @@
  ********************************/
 static FORCE_INLINE U32 LZ4E_getHashLog(tableType_t tableType)
 {
-	if (tableType == byU64)
-		return LZ4E_HASHLOG - 1;
+	if (tableType == byU16Page)
+		return LZ4E_PAGE_HASHLOG;
 
-	if (tableType == byU32)
-		return LZ4E_HASHLOG;
+	if (tableType == byU16)
+		return LZ4E_HASHLOG + 1;
 
-	return LZ4E_HASHLOG + 1;
+	return LZ4E_HASHLOG;
 }
 
 static FORCE_INLINE U32 LZ4E_hash4(
@@ -84,7 +84,7 @@ static FORCE_INLINE U32 LZ4E_hash5(
 
 static FORCE_INLINE U32 LZ4E_hashPosition(
 	const struct bio_vec *bvecs,
-	const struct bvec_iter pos,
+	const LZ4E_cursor_t *pos,
 	const tableType_t tableType)
 {
 #if LZ4_ARCH64
@@ -95,151 +95,192 @@ static FORCE_INLINE U32 LZ4E_hashPosition(
 	return LZ4E_hash4(LZ4E_read32(bvecs, pos), tableType);
 }
 
-static void LZ4E_putPositionOnHash(
-	const struct bvec_iter pos,
+static FORCE_INLINE U32 LZ4E_hashPtr(
+	const BYTE *ptr,
+	const tableType_t tableType)
+{
+#if LZ4_ARCH64
+	if (tableType == byU32)
+		return LZ4E_hash5((U64)LZ4_read_ARCH(ptr), tableType);
+#endif
+
+	return LZ4E_hash4(LZ4_read32(ptr), tableType);
+}
+
+static FORCE_INLINE void LZ4E_putPositionOnHash(
+	const U32 pos,
 	const U32 h,
 	void *tableBase,
-	const tableType_t tableType,
-	const struct bvec_iter baseIter)
+	const tableType_t tableType)
 {
 	switch (tableType) {
-	case byU64: {
-		LZ4E_tbl_addr64_t *hashTable = (LZ4E_tbl_addr64_t *)tableBase;
-		hashTable[h] = LZ4E_TBL_ADDR_FROM_ITER(
-				LZ4E_tbl_addr64_t, pos, baseIter);
+	case clearedTable:
+		/* illegal! */
 		return;
-	}
 	case byU32: {
-		LZ4E_tbl_addr32_t *hashTable = (LZ4E_tbl_addr32_t *)tableBase;
-		hashTable[h] = LZ4E_TBL_ADDR_FROM_ITER(
-				LZ4E_tbl_addr32_t, pos, baseIter);
+		U32 *hashTable = (U32 *)tableBase;
+
+		hashTable[h] = pos;
 		return;
 	}
-	case byU16: {
-		LZ4E_tbl_addr16_t *hashTable = (LZ4E_tbl_addr16_t *)tableBase;
-		hashTable[h] = LZ4E_TBL_ADDR_FROM_ITER(
-				LZ4E_tbl_addr16_t, pos, baseIter);
+	case byU16:
+	case byU16Page: {
+		U16 *hashTable = (U16 *)tableBase;
+
+		hashTable[h] = (U16)pos;
 		return;
 	}}
 }
 
 static FORCE_INLINE void LZ4E_putPosition(
 	const struct bio_vec *bvecs,
-	const struct bvec_iter pos,
+	const LZ4E_cursor_t *cur,
+	const U32 pos,
 	void *tableBase,
-	const tableType_t tableType,
-	const struct bvec_iter baseIter)
+	const tableType_t tableType)
 {
-	U32 const h = LZ4E_hashPosition(bvecs, pos, tableType);
+	U32 const h = LZ4E_hashPosition(bvecs, cur, tableType);
 
-	LZ4E_putPositionOnHash(pos, h, tableBase, tableType, baseIter);
+	LZ4E_putPositionOnHash(pos, h, tableBase, tableType);
 }
 
-static struct bvec_iter LZ4E_getPositionOnHash(
+static FORCE_INLINE U32 LZ4E_getPositionOnHash(
 	const U32 h,
 	void *tableBase,
-	void *biSizeBase,
-	const tableType_t tableType,
-	const struct bvec_iter baseIter)
+	const tableType_t tableType)
 {
-	const U32 *bvIterSize = (const U32 *)biSizeBase;
-
-	if (tableType == byU64) {
-		const LZ4E_tbl_addr64_t *hashTable = (const LZ4E_tbl_addr64_t *)tableBase;
-		const LZ4E_tbl_addr64_t addr = hashTable[h];
-		return ((addr.raw != 0)
-				? LZ4E_TBL_ADDR_TO_ITER(addr, baseIter, bvIterSize)
-				: baseIter);
-	}
 	if (tableType == byU32) {
-		const LZ4E_tbl_addr32_t *hashTable = (const LZ4E_tbl_addr32_t *)tableBase;
-		const LZ4E_tbl_addr32_t addr = hashTable[h];
-		return ((addr.raw != 0)
-				? LZ4E_TBL_ADDR_TO_ITER(addr, baseIter, bvIterSize)
-				: baseIter);
+		const U32 * const hashTable = (U32 *) tableBase;
+
+		return hashTable[h];
 	}
+
 	{
-		const LZ4E_tbl_addr16_t *hashTable = (const LZ4E_tbl_addr16_t *)tableBase;
-		const LZ4E_tbl_addr16_t addr = hashTable[h];
-		return ((addr.raw != 0)
-				? LZ4E_TBL_ADDR_TO_ITER(addr, baseIter, bvIterSize)
-				: baseIter);
+		/* default, to ensure a return */
+		const U16 * const hashTable = (U16 *) tableBase;
+
+		return hashTable[h];
 	}
 }
 
-static FORCE_INLINE struct bvec_iter LZ4E_getPosition(
+static FORCE_INLINE U32 LZ4E_getPosition(
 	const struct bio_vec *bvecs,
-	const struct bvec_iter pos,
+	const LZ4E_cursor_t *cur,
 	void *tableBase,
-	void *biSizeBase,
-	const tableType_t tableType,
-	const struct bvec_iter baseIter)
+	const tableType_t tableType)
 {
-	U32 const h = LZ4E_hashPosition(bvecs, pos, tableType);
+	U32 const h = LZ4E_hashPosition(bvecs, cur, tableType);
 
-	return LZ4E_getPositionOnHash(
-			h, tableBase, biSizeBase, tableType, baseIter);
+	return LZ4E_getPositionOnHash(h, tableBase, tableType);
 }
 
-static bool LZ4E_fillBvIterSize(
-	U32 *bvIterSize,
-	const struct bio_vec *bvecs,
-	const struct bvec_iter start,
-	tableType_t * const tableType)
+/*
+ * Page inputs hash into a smaller part of the table,
+ * but keep the same 2-byte entries as byU16
+ */
+static FORCE_INLINE tableType_t LZ4E_entryType(const tableType_t tableType)
 {
-	struct bvec_iter iter;
-	struct bio_vec curBvec;
-	unsigned int i;
-
-	LZ4E_for_each_bvec(curBvec, bvecs, iter, start) {
-		i = iter.bi_idx - start.bi_idx;
+	return (tableType == byU16Page) ? byU16 : tableType;
+}
 
-		if (i >= BIO_MAX_VECS)
-			return false;
+/*
+ * Get cursor at the given position of the dictionary, fails if there are
+ * less than MINMATCH bytes left in the dictionary from there
+ */
+static FORCE_INLINE bool LZ4E_getDictCursor(
+	const LZ4E_stream_t_internal *dictPtr,
+	const U32 dictPos,
+	LZ4E_cursor_t *cur)
+{
+	const struct bvec_iter dictIter = dictPtr->dictIter;
 
-		if (i >= LZ4E_TBL_ADDR16_IDX_LIMIT
-				|| curBvec.bv_len > LZ4E_TBL_ADDR16_OFF_LIMIT)
-			*tableType |= byU32;
+	if (dictPos + MINMATCH > dictIter.bi_size)
+		return false;
 
-		if (curBvec.bv_len > LZ4E_TBL_ADDR32_OFF_LIMIT)
-			*tableType |= byU64;
+	*cur = LZ4E_cur_init(dictPtr->dictVecs,
+		LZ4E_seg_iter(&dictPtr->dictSegTable, dictIter, dictPos));
+	return true;
+}
 
-		bvIterSize[i] = iter.bi_size + iter.bi_bvec_done;
-	}
+/*
+ * Fill positions of source bvecs for translating match offsets.
+ * Done before dispatching to the instances of LZ4E_compress_generic(),
+ * which expect the segment table to be ready. Fails on too many bvecs.
+ */
+static FORCE_INLINE bool LZ4E_scanInput(
+	LZ4E_stream_t_internal *ctx,
+	const struct bio_vec *src,
+	const struct bvec_iter srcIter)
+{
+	/* Input too small to be searched for matches */
+	if (srcIter.bi_size < LZ4E_MIN_LENGTH)
+		return true;
 
-	return true;
+	return LZ4E_fillSegTable(&ctx->segTable, src, srcIter);
 }
 
+/*
+ * LZ4E_BENCH_GENERIC builds a single out-of-line LZ4E_compress_generic()
+ * instead, which takes its directives at runtime. It is only used by the
+ * userspace benchmark measuring what the specialization gains.
+ */
+#ifdef LZ4E_BENCH_GENERIC
+#define LZ4E_GENERIC_INLINE noinline __attribute__((__noclone__))
+#else
+#define LZ4E_GENERIC_INLINE FORCE_INLINE
+#endif
 
 /*
  * LZ4_compress_generic() :
- * inlined, to ensure branches are decided at compilation time
+ * inlined, to ensure branches are decided at compilation time.
+ * The source segments have to be scanned with LZ4E_scanInput() beforehand.
  */
-static FORCE_INLINE int LZ4E_compress_generic(
+static LZ4E_GENERIC_INLINE int LZ4E_compress_generic(
 	LZ4E_stream_t_internal * const dictPtr,
 	const struct bio_vec * const src,
 	struct bio_vec * const dst,
 	struct bvec_iter * const srcIter,
 	struct bvec_iter * const dstIter,
 	const limitedOutput_directive outputLimited,
-	const dict_directive dict,			// NOTE:(kogora): always noDict
-	const dictIssue_directive dictIssue,		// NOTE:(kogora): always noDictIssue
-	const U32 acceleration)
+	const tableType_t tableType,
+	const dict_directive dict,
+	const U32 acceleration,
+	const U32 probeSize,
+	/* checksum of the input, fed as it is encoded, or NULL */
+	struct xxh32_state * const xxh)
 {
 	const unsigned int inputSize = srcIter->bi_size;
 	const unsigned int maxOutputSize = dstIter->bi_size;
 	const struct bvec_iter srcStart = *srcIter;
-	struct bvec_iter anchorIter = srcStart;
+	const struct bio_vec * const dictVecs = dictPtr->dictVecs;
+	LZ4E_cursor_t srcCur = LZ4E_cur_init(src, *srcIter);
+	LZ4E_cursor_t dstCur = LZ4E_cur_init(dst, *dstIter);
+	LZ4E_cursor_t anchorCur = srcCur;
+	const LZ4E_cursor_t startCur = srcCur;
+	/* Input before this position is fed to 'xxh' */
+	LZ4E_cursor_t hashCur = srcCur;
+	U32 hashPos = 0;
 
 	const U32 mflimit = inputSize - MFLIMIT;
 	const U32 matchlimit = inputSize - LASTLITERALS;
+	/* Matches are searched up to here, until the first one is found */
+	U32 searchLimit = (probeSize && probeSize < mflimit)
+		? probeSize : mflimit;
 
 	U32 srcPos = 0;
 	U32 dstPos = 0;
 	U32 anchorPos = 0;
 	U32 forwardH;
 
-	tableType_t tableType = byU16;
+	/* Hash table entries below this index are left from previous calls */
+	const U32 startIndex = dictPtr->currentOffset;
+	/* Entries between these indexes point into the dictionary */
+	const U32 dictSize = (dict == usingExtDict)
+		? dictPtr->dictIter.bi_size : 0;
+	const U32 lowIndex = startIndex - dictSize;
+	/* Matches closer than this are skipped, see LZ4E_DEC_SPEED_OFFSET */
+	const U32 minOffset = dictPtr->favorDecSpeed
+		? LZ4E_DEC_SPEED_OFFSET : 1;
 
 	/* Init conditions */
 	if (inputSize > LZ4E_MAX_INPUT_SIZE) {
@@ -247,104 +288,208 @@ static FORCE_INLINE int LZ4E_compress_generic(
 		return 0;
 	}
 
-//	TODO:(bgch): dict impl
-//
-//	switch (dict) {
-//	case noDict:
-//	default:
-//		base = (const BYTE *)source;
-//		lowLimit = (const BYTE *)source;
-//		break;
-//	case withPrefix64k:
-//		base = (const BYTE *)source - dictPtr->currentOffset;
-//		lowLimit = (const BYTE *)source - dictPtr->dictSize;
-//		break;
-//	case usingExtDict:
-//		base = (const BYTE *)source - dictPtr->currentOffset;
-//		lowLimit = (const BYTE *)source;
-//		break;
-//	}
+	/*
+	 * Keep table entries of this call below the next start index,
+	 * even if compression fails
+	 */
+	dictPtr->currentOffset += inputSize;
+	dictPtr->tableType = (U32)LZ4E_entryType(tableType);
 
 	if (inputSize < LZ4E_MIN_LENGTH) {
 		/* Input too small, no compression (all literals) */
 		goto _last_literals;
 	}
 
-	/* Fill number of bytes remaining for each bvec */
-	if (!LZ4E_fillBvIterSize(dictPtr->bvIterSize, src, srcStart, &tableType)) {
-		/* Too many bvecs */
-		return 0;
-	}
-
 	/* First Byte */
-	LZ4E_putPosition(src, *srcIter, dictPtr->hashTable, tableType, srcStart);
-	LZ4E_advance1(src, srcIter, &srcPos);
-	forwardH = LZ4E_hashPosition(src, *srcIter, tableType);
+	LZ4E_putPosition(src, &srcCur, startIndex + srcPos,
+		dictPtr->hashTable, tableType);
+	LZ4E_advance1(src, &srcCur, &srcPos);
+	forwardH = LZ4E_hashPosition(src, &srcCur, tableType);
 
 	/* Main Loop */
 	for ( ; ; ) {
 		BYTE token;
-		struct bvec_iter tokenIter;
-		struct bvec_iter matchIter;
+		LZ4E_cursor_t tokenCur;
+		LZ4E_cursor_t matchCur;
+		U32 matchIndex;
 		U32 matchPos;
+		/* Matches in the dictionary are read through its bvecs */
+		bool matchInDict = false;
 
 		/* Find a match */
 		{
-			struct bvec_iter forwardIter = *srcIter;
+			LZ4E_cursor_t forwardCur = srcCur;
 			U32 forwardPos = srcPos;
 			unsigned int step = 1;
 			unsigned int searchMatchNb = acceleration << LZ4_SKIPTRIGGER;
 
-			do {
-				U32 const h = forwardH;
+			for ( ; ; ) {
+				U32 h;
+
+				/*
+				 * Search with plain pointers over the bulk of the
+				 * mapped segment, leaving only the positions whose
+				 * hashing would cross its end to the cursor.
+				 */
+				if (forwardCur.left > HASH_UNIT) {
+					const LZ4E_cursor_t spanCur = forwardCur;
+					const U32 spanPos = forwardPos;
+					const U32 spanLow = spanPos - spanCur.off;
+					const U32 spanLimit = min_t(U32, searchLimit,
+						spanPos + spanCur.left - HASH_UNIT);
+
+					while (forwardPos + step <= spanLimit) {
+						const BYTE *ip = spanCur.ptr
+							+ (forwardPos - spanPos);
+
+						h = forwardH;
+						srcPos = forwardPos;
+						forwardPos += step;
+						step = (searchMatchNb++ >> LZ4_SKIPTRIGGER);
+
+						matchIndex = LZ4E_getPositionOnHash(h,
+							dictPtr->hashTable, tableType);
+						forwardH = LZ4E_hashPtr(spanCur.ptr
+							+ (forwardPos - spanPos),
+							tableType);
+						LZ4E_putPositionOnHash(startIndex + srcPos,
+							h, dictPtr->hashTable, tableType);
+
+						if (matchIndex < lowIndex)
+							continue;
+
+						if ((tableType == byU32)
+							&& (matchIndex + MAX_DISTANCE
+								< startIndex + srcPos))
+							continue;
+
+						if (matchIndex + minOffset
+								> startIndex + srcPos)
+							continue;
+
+						matchPos = matchIndex - startIndex;
+
+						if ((dict == usingExtDict)
+							&& (matchIndex < startIndex)) {
+							if (!LZ4E_getDictCursor(dictPtr,
+									matchIndex - lowIndex,
+									&matchCur))
+								continue;
+
+							if (LZ4E_read32(dictVecs, &matchCur)
+									!= LZ4_read32(ip))
+								continue;
+
+							matchInDict = true;
+						} else if (matchPos >= spanLow) {
+							const BYTE *match = spanCur.ptr
+								+ matchPos - spanPos;
+
+							if (LZ4_read32(match) != LZ4_read32(ip))
+								continue;
+
+							matchCur = LZ4E_cur_at(&spanCur, match);
+						} else {
+							matchCur = LZ4E_cur_init(src,
+								LZ4E_seg_iter(&dictPtr->segTable,
+									srcStart, matchPos));
+
+							if (LZ4E_read32(src, &matchCur)
+									!= LZ4_read32(ip))
+								continue;
+						}
+
+						srcCur = LZ4E_cur_at(&spanCur, ip);
+						goto _catch_up;
+					}
+
+					forwardCur = LZ4E_cur_at(&spanCur, spanCur.ptr
+						+ (forwardPos - spanPos));
+				}
+
+				h = forwardH;
+
+				if (unlikely(forwardPos + step > searchLimit)) {
+					/* Give up if the probe has no matches */
+					if (searchLimit != mflimit)
+						return LZ4E_INCOMPRESSIBLE;
 
-				if (unlikely(forwardPos + step > mflimit))
 					goto _last_literals;
+				}
 
-				*srcIter = forwardIter;
+				srcCur = forwardCur;
 				srcPos = forwardPos;
-				LZ4E_advance(src, &forwardIter, &forwardPos, step);
+				LZ4E_advance(src, &forwardCur, &forwardPos, step);
 				step = (searchMatchNb++ >> LZ4_SKIPTRIGGER);
 
-				matchIter = LZ4E_getPositionOnHash(h,
-					dictPtr->hashTable,
-					dictPtr->bvIterSize,
-					tableType, srcStart);
-				matchPos = LZ4E_ITER_POS(matchIter, srcStart);
-
-//				TODO:(bgch): dict impl
-//
-//				if (dict == usingExtDict) {
-//					if (match < (const BYTE *)source) {
-//						refDelta = dictDelta;
-//						lowLimit = dictionary;
-//					} else {
-//						refDelta = 0;
-//						lowLimit = (const BYTE *)source;
-//				}	 }
+				matchIndex = LZ4E_getPositionOnHash(h,
+					dictPtr->hashTable, tableType);
 
 				forwardH = LZ4E_hashPosition(src,
-					forwardIter, tableType);
-
-				LZ4E_putPositionOnHash(*srcIter, h,
-					dictPtr->hashTable, tableType, srcStart);
-			} while (((tableType == byU16)
-					? 0
-					: (matchPos + MAX_DISTANCE < srcPos))
-				|| (LZ4E_read32(src, matchIter)
-					!= LZ4E_read32(src, *srcIter)));
+					&forwardCur, tableType);
+
+				LZ4E_putPositionOnHash(startIndex + srcPos, h,
+					dictPtr->hashTable, tableType);
+
+				if (matchIndex < lowIndex)
+					continue;
+
+				if ((tableType == byU32)
+					&& (matchIndex + MAX_DISTANCE
+						< startIndex + srcPos))
+					continue;
+
+				if (matchIndex + minOffset > startIndex + srcPos)
+					continue;
+
+				matchPos = matchIndex - startIndex;
+
+				if ((dict == usingExtDict)
+					&& (matchIndex < startIndex)) {
+					if (!LZ4E_getDictCursor(dictPtr,
+							matchIndex - lowIndex, &matchCur))
+						continue;
+
+					if (LZ4E_read32(dictVecs, &matchCur)
+							== LZ4E_read32(src, &srcCur)) {
+						matchInDict = true;
+						break;
+					}
+
+					continue;
+				}
+
+				matchCur = LZ4E_getCursorNear(src, matchPos,
+					&dictPtr->segTable, srcStart,
+					&srcCur, srcPos);
+
+				if (LZ4E_read32(src, &matchCur)
+						== LZ4E_read32(src, &srcCur))
+					break;
+			}
 		}
 
+_catch_up:
+		searchLimit = mflimit;
+
 		/* Catch up */
-		while ((srcPos > anchorPos) && (matchPos > 0)) {
-			LZ4E_rollback1(src, srcIter, &srcPos);
-			LZ4E_rollback1(src, &matchIter, &matchPos);
-
-			if (likely(LZ4E_read8(src, *srcIter)
-				!= LZ4E_read8(src, matchIter))) {
-				LZ4E_advance1(src, srcIter, &srcPos);
-				LZ4E_advance1(src, &matchIter, &matchPos);
-				break;
+		{
+			const struct bio_vec * const matchVecs =
+				matchInDict ? dictVecs : src;
+			/* Matches do not extend back over the buffer start */
+			const U32 matchLow = matchInDict
+				? lowIndex - startIndex : 0;
+
+			while ((srcPos > anchorPos) && (matchPos != matchLow)) {
+				LZ4E_rollback1(src, &srcCur, &srcPos);
+				LZ4E_rollback1(matchVecs, &matchCur, &matchPos);
+
+				if (likely(LZ4E_read8(src, &srcCur)
+					!= LZ4E_read8(matchVecs, &matchCur))) {
+					LZ4E_advance1(src, &srcCur, &srcPos);
+					LZ4E_advance1(matchVecs, &matchCur, &matchPos);
+					break;
+				}
 			}
 		}
 
@@ -352,77 +497,95 @@ static FORCE_INLINE int LZ4E_compress_generic(
 		{
 			const unsigned int litLength = srcPos - anchorPos;
 
-			tokenIter = *dstIter;
-			LZ4E_advance1(dst, dstIter, &dstPos);
-
-			if ((outputLimited) &&
+			if ((outputLimited == limitedOutput) &&
 				/* Check output buffer overflow */
-				(unlikely(dstPos + litLength +
+				(unlikely(dstPos + 1 + litLength +
 					(2 + 1 + LASTLITERALS) +
 					(litLength / 255) > maxOutputSize)))
 				return 0;
 
+			/*
+			 * Leave room for the shortest match and enough last
+			 * literals after it, or end the block here
+			 */
+			if ((outputLimited == fillOutput) &&
+				(unlikely(dstPos + 1 + (litLength + 240) / 255
+					+ litLength + 2 + 1 + MFLIMIT - MINMATCH
+					> maxOutputSize)))
+				goto _last_literals;
+
+			tokenCur = dstCur;
+			LZ4E_advance1(dst, &dstCur, &dstPos);
+
 			if (litLength >= RUN_MASK) {
 				unsigned int len = litLength - RUN_MASK;
 
 				token = (RUN_MASK << ML_BITS);
 
 				for (; len >= 255; len -= 255) {
-					LZ4E_write8(dst, 255, *dstIter);
-					LZ4E_advance1(dst, dstIter, &dstPos);
+					LZ4E_write8(dst, 255, &dstCur);
+					LZ4E_advance1(dst, &dstCur, &dstPos);
 				}
-				LZ4E_write8(dst, (BYTE)len, *dstIter);
-				LZ4E_advance1(dst, dstIter, &dstPos);
+				LZ4E_write8(dst, (BYTE)len, &dstCur);
+				LZ4E_advance1(dst, &dstCur, &dstPos);
 			} else
 				token = (BYTE)(litLength << ML_BITS);
 
 			/* Copy Literals */
-			LZ4E_wildCopy(dst, src, *dstIter, anchorIter, litLength);
-			LZ4E_advance(dst, dstIter, &dstPos, litLength);
+			LZ4E_wildCopy(dst, src, dstCur, anchorCur, litLength);
+			LZ4E_advance(dst, &dstCur, &dstPos, litLength);
 		}
 
 _next_match:
-		/* Encode Offset */
-		LZ4E_writeLE16(dst, (U16)(srcPos - matchPos), *dstIter);
-		LZ4E_advance(dst, dstIter, &dstPos, 2);
+		/* Encode Offset, wraps around for matches in the dictionary */
+		LZ4E_writeLE16(dst, (U16)(srcPos - matchPos), &dstCur);
+		LZ4E_advance(dst, &dstCur, &dstPos, 2);
 
 		/* Encode MatchLength */
 		{
 			unsigned int matchCode;
 
-//			TODO:(bgch): dict impl
-//
-//			if ((dict == usingExtDict)
-//				&& (lowLimit == dictionary)) {
-//				const BYTE *limit;
-//
-//				matchIter += refDelta;
-//				limit = ip + (dictEnd - match);
-//
-//				if (limit > matchlimit)
-//					limit = matchlimit;
-//
-//				matchCode = LZ4_count(ip + MINMATCH,
-//					match + MINMATCH, limit);
-//
-//				ip += MINMATCH + matchCode;
-//
-//				if (ip == limit) {
-//					unsigned const int more = LZ4_count(ip,
-//						(const BYTE *)source,
-//						matchlimit);
-//
-//					matchCode += more;
-//					ip += more;
-//				}
-//			} else {
-//
-			LZ4E_advance(src, srcIter, &srcPos, MINMATCH);
-			LZ4E_advance(src, &matchIter, &matchPos, MINMATCH);
-			matchCode = LZ4E_count(src, *srcIter, matchIter, matchlimit - srcPos);
-			LZ4E_advance(src, srcIter, &srcPos, matchCode);
-
-			if ((outputLimited) &&
+			LZ4E_advance(src, &srcCur, &srcPos, MINMATCH);
+
+			if ((dict == usingExtDict) && matchInDict) {
+				/* Count up to the dictionary end first */
+				const U32 dictLeft = 0U - matchPos - MINMATCH;
+				const U32 limit = min_t(U32,
+					matchlimit - srcPos, dictLeft);
+
+				LZ4E_advance(dictVecs, &matchCur, &matchPos,
+					MINMATCH);
+				matchCode = LZ4E_count(src, srcCur, dictVecs,
+					matchCur, limit);
+
+				/* Then continue from the input start */
+				if (matchCode == dictLeft) {
+					LZ4E_cursor_t moreCur = srcCur;
+
+					LZ4E_cur_advance(src, &moreCur, matchCode);
+					matchCode += LZ4E_count(src, moreCur,
+						src, startCur,
+						matchlimit - srcPos - matchCode);
+				}
+			} else {
+				LZ4E_advance(src, &matchCur, &matchPos, MINMATCH);
+				matchCode = LZ4E_count(src, srcCur, src, matchCur,
+					matchlimit - srcPos);
+			}
+
+			if ((outputLimited == fillOutput) &&
+				(unlikely(dstPos + (1 + LASTLITERALS)
+					+ (matchCode + 240) / 255
+					> maxOutputSize))) {
+				/* Too long, cut it to what fits */
+				matchCode = ML_MASK - 1
+					+ (maxOutputSize - dstPos
+						- 1 - LASTLITERALS) * 255;
+			}
+
+			LZ4E_advance(src, &srcCur, &srcPos, matchCode);
+
+			if ((outputLimited == limitedOutput) &&
 				/* Check output buffer overflow */
 				(unlikely(dstPos +
 					(1 + LASTLITERALS) +
@@ -432,131 +595,415 @@ _next_match:
 			if (matchCode >= ML_MASK) {
 				token += ML_MASK;
 				matchCode -= ML_MASK;
-				LZ4E_write32(dst, 0xFFFFFFFF, *dstIter);
+				LZ4E_write32(dst, 0xFFFFFFFF, &dstCur);
 
 				while (matchCode >= 4 * 255) {
-					LZ4E_advance(dst, dstIter, &dstPos, 4);
-					LZ4E_write32(dst, 0xFFFFFFFF, *dstIter);
+					LZ4E_advance(dst, &dstCur, &dstPos, 4);
+					LZ4E_write32(dst, 0xFFFFFFFF, &dstCur);
 					matchCode -= 4 * 255;
 				}
 
-				LZ4E_advance(dst, dstIter, &dstPos, matchCode / 255);
-				LZ4E_write8(dst, (BYTE)(matchCode % 255), *dstIter);
-				LZ4E_advance1(dst, dstIter, &dstPos);
+				LZ4E_advance(dst, &dstCur, &dstPos, matchCode / 255);
+				LZ4E_write8(dst, (BYTE)(matchCode % 255), &dstCur);
+				LZ4E_advance1(dst, &dstCur, &dstPos);
 			} else
 				token += (BYTE)(matchCode);
 
-			LZ4E_write8(dst, token, tokenIter);
+			LZ4E_write8(dst, token, &tokenCur);
+		}
+
+		/* Hash encoded input in spans, while it is still in cache */
+		if (xxh && (srcPos - hashPos >= LZ4E_XXH_SPAN)) {
+			LZ4E_xxh32_update(xxh, src, hashCur, srcPos - hashPos);
+			hashCur = srcCur;
+			hashPos = srcPos;
 		}
 
-		anchorIter = *srcIter;
+		anchorCur = srcCur;
 		anchorPos = srcPos;
 
 		/* Test end of chunk */
 		if (srcPos > mflimit)
 			break;
 
+		/* Same room as for literals, needed by the next position */
+		if ((outputLimited == fillOutput) &&
+			(dstPos + 1 + 2 + 1 + MFLIMIT - MINMATCH > maxOutputSize))
+			break;
+
 		/* TODO:(bgch): maybe remove this */
 		/* Fill table */
-		LZ4E_rollback1(src, srcIter, &srcPos);
-		LZ4E_rollback1(src, srcIter, &srcPos);
-		LZ4E_putPosition(src, *srcIter, dictPtr->hashTable, tableType, srcStart);
-		LZ4E_advance(src, srcIter, &srcPos, 2);
+		LZ4E_rollback1(src, &srcCur, &srcPos);
+		LZ4E_rollback1(src, &srcCur, &srcPos);
+		LZ4E_putPosition(src, &srcCur, startIndex + srcPos,
+			dictPtr->hashTable, tableType);
+		LZ4E_advance(src, &srcCur, &srcPos, 2);
 
 		/* Test next position */
-		matchIter = LZ4E_getPosition(src, *srcIter,
-			dictPtr->hashTable, dictPtr->bvIterSize,
-			tableType, srcStart);
-		matchPos = LZ4E_ITER_POS(matchIter, srcStart);
-
-//		TODO:(bgch): dict impl
-//
-//		if (dict == usingExtDict) {
-//			if (match < (const BYTE *)source) {
-//				refDelta = dictDelta;
-//				lowLimit = dictionary;
-//			} else {
-//				refDelta = 0;
-//				lowLimit = (const BYTE *)source;
-//			}
-//		}
-
-		LZ4E_putPosition(src, *srcIter, dictPtr->hashTable, tableType, srcStart);
-
-		if ((matchPos + MAX_DISTANCE >= srcPos)
-			&& (LZ4E_read32(src, *srcIter)
-				== LZ4E_read32(src, matchIter))) {
-			token = 0;
-			tokenIter = *dstIter;
-			LZ4E_advance1(dst, dstIter, &dstPos);
-			goto _next_match;
+		matchIndex = LZ4E_getPosition(src, &srcCur,
+			dictPtr->hashTable, tableType);
+
+		LZ4E_putPosition(src, &srcCur, startIndex + srcPos,
+			dictPtr->hashTable, tableType);
+
+		if ((matchIndex >= lowIndex)
+			&& (matchIndex + MAX_DISTANCE >= startIndex + srcPos)
+			&& (matchIndex + minOffset <= startIndex + srcPos)) {
+			matchPos = matchIndex - startIndex;
+			matchInDict = (dict == usingExtDict)
+				&& (matchIndex < startIndex);
+
+			if (matchInDict) {
+				if (LZ4E_getDictCursor(dictPtr,
+						matchIndex - lowIndex, &matchCur)
+					&& (LZ4E_read32(src, &srcCur)
+						== LZ4E_read32(dictVecs, &matchCur))) {
+					token = 0;
+					tokenCur = dstCur;
+					LZ4E_advance1(dst, &dstCur, &dstPos);
+					goto _next_match;
+				}
+			} else {
+				matchCur = LZ4E_getCursorNear(src, matchPos,
+					&dictPtr->segTable, srcStart,
+					&srcCur, srcPos);
+
+				if (LZ4E_read32(src, &srcCur)
+						== LZ4E_read32(src, &matchCur)) {
+					token = 0;
+					tokenCur = dstCur;
+					LZ4E_advance1(dst, &dstCur, &dstPos);
+					goto _next_match;
+				}
+			}
 		}
 
 		/* Prepare next loop */
-		LZ4E_advance1(src, srcIter, &srcPos);
-		forwardH = LZ4E_hashPosition(src, *srcIter, tableType);
+		LZ4E_advance1(src, &srcCur, &srcPos);
+		forwardH = LZ4E_hashPosition(src, &srcCur, tableType);
 	}
 
 _last_literals:
 	/* Encode Last Literals */
 	{
-		const size_t lastRun = (size_t)(inputSize - anchorPos);
+		size_t lastRun = (size_t)(inputSize - anchorPos);
 
 		if ((outputLimited) &&
 			/* Check output buffer overflow */
 			(dstPos + lastRun + 1 +
-			((lastRun + 255 - RUN_MASK) / 255) > (U32)maxOutputSize))
-			return 0;
+			((lastRun + 255 - RUN_MASK) / 255) > (U32)maxOutputSize)) {
+			if (outputLimited != fillOutput)
+				return 0;
+
+			/* Take as much of the input as fits */
+			lastRun = (size_t)(maxOutputSize - dstPos) - 1;
+			lastRun -= (lastRun + 256 - RUN_MASK) / 256;
+		}
 
 		if (lastRun >= RUN_MASK) {
 			size_t accumulator = lastRun - RUN_MASK;
 
-			LZ4E_write8(dst, RUN_MASK << ML_BITS, *dstIter);
-			LZ4E_advance1(dst, dstIter, &dstPos);
+			LZ4E_write8(dst, RUN_MASK << ML_BITS, &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
 
 			for (; accumulator >= 255; accumulator -= 255) {
-				LZ4E_write8(dst, 255, *dstIter);
-				LZ4E_advance1(dst, dstIter, &dstPos);
+				LZ4E_write8(dst, 255, &dstCur);
+				LZ4E_advance1(dst, &dstCur, &dstPos);
 			}
-			LZ4E_write8(dst, (BYTE)accumulator, *dstIter);
-			LZ4E_advance1(dst, dstIter, &dstPos);
+			LZ4E_write8(dst, (BYTE)accumulator, &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
 		} else {
-			LZ4E_write8(dst, (BYTE)(lastRun << ML_BITS), *dstIter);
-			LZ4E_advance1(dst, dstIter, &dstPos);
+			LZ4E_write8(dst, (BYTE)(lastRun << ML_BITS), &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
 		}
 
-		LZ4E_memcpy(dst, src, *dstIter, anchorIter, lastRun);
-		dstPos += lastRun;
+		LZ4E_memcpy(dst, src, dstCur, anchorCur, lastRun);
+		LZ4E_advance(dst, &dstCur, &dstPos, lastRun);
+
+		if (xxh)
+			LZ4E_xxh32_update(xxh, src, hashCur,
+				anchorPos + lastRun - hashPos);
+
+		LZ4E_cur_advance(src, &anchorCur, lastRun);
 	}
 
+	/* Report positions right after the consumed and written data */
+	*srcIter = anchorCur.iter;
+	*dstIter = dstCur.iter;
+
 	/* End */
 	return (int)dstPos;
 }
 
+/*
+ * Invalidate hash table entries left from previous calls without clearing
+ * the table, unless the indexes are about to overflow the entry type.
+ */
+static void LZ4E_prepareTable(
+	LZ4E_stream_t_internal * const ctx,
+	const unsigned int inputSize,
+	const tableType_t tableType)
+{
+	if ((tableType_t)ctx->tableType != clearedTable) {
+		if ((tableType_t)ctx->tableType != tableType
+			|| ((tableType == byU16)
+				&& (ctx->currentOffset + inputSize >= 0xFFFFU))
+			|| ((tableType == byU32)
+				&& (ctx->currentOffset > 1 * GB))) {
+			memset(ctx->hashTable, 0, sizeof(ctx->hashTable));
+			ctx->currentOffset = 0;
+			ctx->tableType = (U32)clearedTable;
+		}
+	}
+
+	/*
+	 * Entries of the previous call may still be within MAX_DISTANCE
+	 * of the new start index, so keep them out of reach
+	 */
+	if (ctx->currentOffset != 0 && tableType == byU32)
+		ctx->currentOffset += 64 * KB;
+}
+
+/*
+ * compare a mapped span with the pattern starting from its byte 'phase',
+ * four words at a time
+ */
+static bool LZ4E_spanSameFilled(const BYTE *ptr, const size_t len,
+	const BYTE *pat, const unsigned int phase)
+{
+	const unsigned long word = get_unaligned(
+		(const unsigned long *)(pat + phase));
+	const BYTE * const end = ptr + len;
+	size_t i;
+
+	for (; ptr + 4 * sizeof(word) <= end; ptr += 4 * sizeof(word)) {
+		const unsigned long *w = (const unsigned long *)ptr;
+
+		if ((get_unaligned(w) ^ word) | (get_unaligned(w + 1) ^ word)
+			| (get_unaligned(w + 2) ^ word)
+			| (get_unaligned(w + 3) ^ word))
+			return false;
+	}
+
+	for (; ptr + sizeof(word) <= end; ptr += sizeof(word))
+		if (get_unaligned((const unsigned long *)ptr) != word)
+			return false;
+
+	for (i = 0; ptr < end; ptr++, i++)
+		if (*ptr != pat[phase + i])
+			return false;
+
+	return true;
+}
+
+bool LZ4E_same_filled(const struct bio_vec *src, struct bvec_iter iter,
+	unsigned long *pattern)
+{
+	const unsigned int size = iter.bi_size;
+	/* The pattern twice, so it can be read from any of its bytes */
+	BYTE pat[2 * sizeof(unsigned long)];
+	LZ4E_cursor_t cur;
+	U32 pos = 0;
+
+	if (!size || size % sizeof(unsigned long))
+		return false;
+
+	cur = LZ4E_cur_init(src, iter);
+
+	LZ4E_memcpy_from_cur(pat, src, &cur, sizeof(unsigned long));
+	memcpy(pat + sizeof(unsigned long), pat, sizeof(unsigned long));
+
+	while (pos < size) {
+		/* Segments may split the input in the middle of a word */
+		const unsigned int phase = pos % sizeof(unsigned long);
+		size_t span = min_t(size_t, size - pos, cur.left);
+
+		if (likely(span)) {
+			if (!LZ4E_spanSameFilled(cur.ptr, span, pat, phase))
+				return false;
+		} else {
+			BYTE buf[sizeof(unsigned long)];
+
+			span = min_t(size_t, size - pos, sizeof(buf));
+			LZ4E_memcpy_from_cur(buf, src, &cur, span);
+
+			if (memcmp(buf, pat + phase, span))
+				return false;
+		}
+
+		pos += span;
+
+		if (pos < size)
+			LZ4E_cur_advance(src, &cur, span);
+	}
+
+	*pattern = get_unaligned((const unsigned long *)pat);
+	return true;
+}
+EXPORT_SYMBOL(LZ4E_same_filled);
+
+/*
+ * Same-filled input is encoded without searching: the pattern word as
+ * literals, then a single match repeating it with the offset of a word,
+ * then the last literals.
+ */
+static int LZ4E_compress_sameFilled(
+	const struct bio_vec *src,
+	struct bio_vec *dst,
+	struct bvec_iter *srcIter,
+	struct bvec_iter *dstIter,
+	const unsigned long pattern)
+{
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int litLength = sizeof(pattern);
+	const unsigned int matchLength = inputSize - litLength - LASTLITERALS;
+	unsigned int matchCode = matchLength - MINMATCH;
+	const unsigned int outputSize = 1 + litLength + 2
+		+ (matchCode >= ML_MASK ? (matchCode - ML_MASK) / 255 + 1 : 0)
+		+ 1 + LASTLITERALS;
+	LZ4E_cursor_t dstCur = LZ4E_cur_init(dst, *dstIter);
+	BYTE pat[2 * sizeof(pattern)];
+	U32 dstPos = 0;
+
+	if (outputSize > dstIter->bi_size)
+		return 0;
+
+	put_unaligned(pattern, (unsigned long *)pat);
+	put_unaligned(pattern, (unsigned long *)(pat + sizeof(pattern)));
+
+	LZ4E_write8(dst, (BYTE)((litLength << ML_BITS)
+		+ min_t(unsigned int, matchCode, ML_MASK)), &dstCur);
+	LZ4E_advance1(dst, &dstCur, &dstPos);
+	LZ4E_memcpy_to_cur(dst, pat, &dstCur, litLength);
+	LZ4E_advance(dst, &dstCur, &dstPos, litLength);
+	LZ4E_writeLE16(dst, (U16)litLength, &dstCur);
+	LZ4E_advance(dst, &dstCur, &dstPos, 2);
+
+	if (matchCode >= ML_MASK) {
+		for (matchCode -= ML_MASK; matchCode >= 255; matchCode -= 255) {
+			LZ4E_write8(dst, 255, &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
+		}
+		LZ4E_write8(dst, (BYTE)matchCode, &dstCur);
+		LZ4E_advance1(dst, &dstCur, &dstPos);
+	}
+
+	/* The input is a whole number of words, so it ends with a full one */
+	LZ4E_write8(dst, (BYTE)(LASTLITERALS << ML_BITS), &dstCur);
+	LZ4E_advance1(dst, &dstCur, &dstPos);
+	LZ4E_memcpy_to_cur(dst, pat + sizeof(pat) - LASTLITERALS,
+		&dstCur, LASTLITERALS);
+	LZ4E_advance(dst, &dstCur, &dstPos, LASTLITERALS);
+
+	bvec_iter_advance(src, srcIter, inputSize);
+	*dstIter = dstCur.iter;
+
+	return (int)dstPos;
+}
+
+/*
+ * Inputs of up to LZ4E_PAGE_INPUT_MAX get their own instances with a smaller hash,
+ * kept out of LZ4E_compress_fast_extState(): gcc optimizes the main loop
+ * noticeably worse once a single function holds more of its copies.
+ */
+static noinline int LZ4E_compress_page(
+	LZ4E_stream_t_internal * const ctx,
+	const struct bio_vec *src,
+	struct bio_vec *dst,
+	struct bvec_iter *srcIter,
+	struct bvec_iter *dstIter,
+	const U32 acceleration,
+	const U32 probeSize,
+	struct xxh32_state *xxh)
+{
+	if (dstIter->bi_size >= LZ4E_COMPRESSBOUND(srcIter->bi_size))
+		return LZ4E_compress_generic(ctx, src, dst, srcIter, dstIter,
+			noLimit, byU16Page, noDict, acceleration, probeSize,
+			xxh);
+	else
+		return LZ4E_compress_generic(ctx, src, dst, srcIter, dstIter,
+			limitedOutput, byU16Page, noDict, acceleration,
+			probeSize, xxh);
+}
+
 static int LZ4E_compress_fast_extState(
 	void *state,
 	const struct bio_vec *src,
 	struct bio_vec *dst,
 	struct bvec_iter *srcIter,
 	struct bvec_iter *dstIter,
-	int acceleration)
+	int acceleration,
+	const unsigned int probeSize,
+	struct xxh32_state *xxh)
 {
 	LZ4E_stream_t_internal *ctx = &((LZ4E_stream_t *)state)->internal_donotuse;
 	const unsigned int inputSize = srcIter->bi_size;
 	const unsigned int maxOutputSize = dstIter->bi_size;
 
-	memset(state, 0, sizeof(LZ4E_stream_t));
+	const tableType_t tableType = (inputSize <= LZ4E_PAGE_INPUT_MAX)
+		? byU16Page
+		: (inputSize < LZ4_64Klimit) ? byU16 : byU32;
+
+	unsigned long pattern;
+
+	LZ4_STATIC_ASSERT(sizeof(LZ4E_stream_t_internal) <= LZ4E_STREAMSIZE);
+	LZ4_STATIC_ASSERT((1 << LZ4E_PAGE_HASHLOG) * sizeof(U16)
+		<= sizeof(ctx->hashTable));
+
+	/*
+	 * Same-filled input, such as zero pages, takes no search at all,
+	 * the hash table is left as it was. Its match has the offset of
+	 * a word, too close for favorDecSpeed on 32-bit.
+	 */
+	if (!ctx->skipSameFilled
+		&& inputSize >= sizeof(pattern) + MFLIMIT
+		&& (sizeof(pattern) >= LZ4E_DEC_SPEED_OFFSET
+			|| !ctx->favorDecSpeed)
+		&& inputSize <= LZ4E_MAX_INPUT_SIZE
+		&& LZ4E_same_filled(src, *srcIter, &pattern)) {
+		if (xxh) {
+			LZ4E_cursor_t cur = LZ4E_cur_init(src, *srcIter);
+
+			LZ4E_xxh32_update(xxh, src, cur, inputSize);
+		}
+
+		return LZ4E_compress_sameFilled(src, dst, srcIter, dstIter,
+			pattern);
+	}
+
+	LZ4E_prepareTable(ctx, inputSize, LZ4E_entryType(tableType));
 
 	if (acceleration < 1)
 		acceleration = LZ4E_ACCELERATION_DEFAULT;
 
+	if (acceleration > LZ4E_ACCELERATION_MAX)
+		acceleration = LZ4E_ACCELERATION_MAX;
+
+	if (!LZ4E_scanInput(ctx, src, *srcIter))
+		return 0;
+
+	if (tableType == byU16Page)
+		return LZ4E_compress_page(ctx, src, dst, srcIter, dstIter,
+			(U32)acceleration, probeSize, xxh);
+
 	if (maxOutputSize >= LZ4E_COMPRESSBOUND(inputSize)) {
-		return LZ4E_compress_generic(ctx, src, dst, srcIter, dstIter,
-			noLimit, noDict, noDictIssue, (U32)acceleration);
+		if (tableType == byU16)
+			return LZ4E_compress_generic(ctx, src, dst, srcIter,
+				dstIter, noLimit, byU16, noDict,
+				(U32)acceleration, probeSize, xxh);
+		else
+			return LZ4E_compress_generic(ctx, src, dst, srcIter,
+				dstIter, noLimit, byU32, noDict,
+				(U32)acceleration, probeSize, xxh);
 	} else {
-		return LZ4E_compress_generic(ctx,
-			src, dst, srcIter, dstIter,
-			limitedOutput, noDict, noDictIssue, (U32)acceleration);
+		if (tableType == byU16)
+			return LZ4E_compress_generic(ctx, src, dst, srcIter,
+				dstIter, limitedOutput, byU16, noDict,
+				(U32)acceleration, probeSize, xxh);
+		else
+			return LZ4E_compress_generic(ctx, src, dst, srcIter,
+				dstIter, limitedOutput, byU32, noDict,
+				(U32)acceleration, probeSize, xxh);
 	}
 }
 
@@ -564,10 +1011,326 @@ int LZ4E_compress_default(const struct bio_vec *src, struct bio_vec *dst,
 	struct bvec_iter *srcIter, struct bvec_iter *dstIter, void *wrkmem)
 {
 	return LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
-		dstIter, LZ4E_ACCELERATION_DEFAULT);
+		dstIter, LZ4E_ACCELERATION_DEFAULT, 0, NULL);
 }
 EXPORT_SYMBOL(LZ4E_compress_default);
 
+int LZ4E_compress_fast(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int acceleration, void *wrkmem)
+{
+	return LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
+		dstIter, acceleration, 0, NULL);
+}
+EXPORT_SYMBOL(LZ4E_compress_fast);
+
+int LZ4E_compress_probe(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int acceleration, unsigned int probeSize, void *wrkmem)
+{
+	return LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
+		dstIter, acceleration, probeSize, NULL);
+}
+EXPORT_SYMBOL(LZ4E_compress_probe);
+
+int LZ4E_compress_destSize(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter, void *wrkmem)
+{
+	LZ4E_stream_t_internal *ctx =
+		&((LZ4E_stream_t *)wrkmem)->internal_donotuse;
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int targetDstSize = dstIter->bi_size;
+
+	/* The whole input fits in any case */
+	if (targetDstSize >= LZ4E_COMPRESSBOUND(inputSize))
+		return LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
+			dstIter, LZ4E_ACCELERATION_DEFAULT, 0, NULL);
+
+	if (!targetDstSize)
+		return 0;
+
+	if (inputSize < LZ4_64Klimit) {
+		LZ4E_prepareTable(ctx, inputSize, byU16);
+
+		if (!LZ4E_scanInput(ctx, src, *srcIter))
+			return 0;
+
+		return LZ4E_compress_generic(ctx, src, dst, srcIter, dstIter,
+			fillOutput, byU16, noDict, LZ4E_ACCELERATION_DEFAULT,
+			0, NULL);
+	} else {
+		LZ4E_prepareTable(ctx, inputSize, byU32);
+
+		if (!LZ4E_scanInput(ctx, src, *srcIter))
+			return 0;
+
+		return LZ4E_compress_generic(ctx, src, dst, srcIter, dstIter,
+			fillOutput, byU32, noDict, LZ4E_ACCELERATION_DEFAULT,
+			0, NULL);
+	}
+}
+EXPORT_SYMBOL(LZ4E_compress_destSize);
+
+int LZ4E_compress_fast_xxh32(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int acceleration, uint32_t *checksum, void *wrkmem)
+{
+	struct xxh32_state state;
+	int ret;
+
+	if (!checksum)
+		return LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
+			dstIter, acceleration, 0, NULL);
+
+	xxh32_reset(&state, 0);
+
+	ret = LZ4E_compress_fast_extState(wrkmem, src, dst, srcIter,
+		dstIter, acceleration, 0, &state);
+	if (ret > 0)
+		*checksum = xxh32_digest(&state);
+
+	return ret;
+}
+EXPORT_SYMBOL(LZ4E_compress_fast_xxh32);
+
+/*
+ * Write a little-endian 32-bit field of the block index at 'iter'
+ */
+static void LZ4E_writeBlocksField(struct bio_vec *dst,
+	struct bvec_iter *iter, const U32 value)
+{
+	BYTE field[4];
+
+	put_unaligned_le32(value, field);
+	LZ4E_memcpy_to_sg(dst, (const char *)field, *iter, sizeof(field));
+	bvec_iter_advance(dst, iter, sizeof(field));
+}
+
+int LZ4E_compress_blocks(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int acceleration, void *wrkmem)
+{
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int blocks = LZ4E_BLOCKS_COUNT(inputSize);
+	const unsigned int headerSize = LZ4E_BLOCKS_HEADER_SIZE(blocks);
+	struct bvec_iter fieldIter = *dstIter;
+	struct bvec_iter blockSrc = *srcIter;
+	struct bvec_iter blockDst = *dstIter;
+	unsigned int outputSize = headerSize;
+	unsigned int i;
+
+	if (inputSize > LZ4E_MAX_INPUT_SIZE || dstIter->bi_size < headerSize)
+		return 0;
+
+	LZ4E_writeBlocksField(dst, &fieldIter, inputSize);
+	bvec_iter_advance(dst, &blockDst, headerSize);
+
+	for (i = 0; i < blocks; i++) {
+		const unsigned int blockSize = min_t(unsigned int,
+			blockSrc.bi_size, LZ4E_BLOCK_SIZE);
+		struct bvec_iter inIter = blockSrc;
+		struct bvec_iter outIter = blockDst;
+		int written;
+
+		inIter.bi_size = blockSize;
+
+		/* Every block starts with no history, so it decodes alone */
+		written = LZ4E_compress_fast_extState(wrkmem, src, dst,
+			&inIter, &outIter, acceleration, 0, NULL);
+
+		if (!written)
+			return 0;
+
+		LZ4E_writeBlocksField(dst, &fieldIter, (U32)written);
+		bvec_iter_advance(src, &blockSrc, blockSize);
+		bvec_iter_advance(dst, &blockDst, (unsigned int)written);
+		outputSize += (unsigned int)written;
+	}
+
+	*srcIter = blockSrc;
+	*dstIter = blockDst;
+
+	return (int)outputSize;
+}
+EXPORT_SYMBOL(LZ4E_compress_blocks);
+
+void LZ4E_resetStream(LZ4E_stream_t *stream)
+{
+	memset(stream, 0, sizeof(*stream));
+}
+EXPORT_SYMBOL(LZ4E_resetStream);
+
+void LZ4E_favorDecompressionSpeed(LZ4E_stream_t *stream, int favor)
+{
+	stream->internal_donotuse.favorDecSpeed = (favor != 0);
+}
+EXPORT_SYMBOL(LZ4E_favorDecompressionSpeed);
+
+void LZ4E_skipSameFilled(LZ4E_stream_t *stream, int skip)
+{
+	stream->internal_donotuse.skipSameFilled = (skip != 0);
+}
+EXPORT_SYMBOL(LZ4E_skipSameFilled);
+
+/*-******************************
+ *	Streaming functions
+ ********************************/
+/*
+ * make the last 64KB of the old dictionary followed by 'srcIter'
+ * the new dictionary
+ */
+static void LZ4E_appendDict(
+	LZ4E_stream_t_internal *ctx,
+	const struct bio_vec *src,
+	struct bvec_iter srcIter)
+{
+	LZ4E_appendVecs(ctx->dictVecs, &ctx->dictIter, &ctx->dictSegTable,
+		src, srcIter);
+}
+
+/*
+ * rebase indexes before they overflow, keeping the dictionary in reach
+ */
+static void LZ4E_renormDictT(LZ4E_stream_t_internal *ctx,
+	const unsigned int inputSize)
+{
+	if (ctx->currentOffset + inputSize > 0x80000000) {
+		/* rescale hash table */
+		const U32 delta = ctx->currentOffset - 64 * KB;
+		int i;
+
+		for (i = 0; i < LZ4E_HASH_SIZE_U32; i++) {
+			if (ctx->hashTable[i] < delta)
+				ctx->hashTable[i] = 0;
+			else
+				ctx->hashTable[i] -= delta;
+		}
+
+		ctx->currentOffset = 64 * KB;
+	}
+}
+
+int LZ4E_loadDict(LZ4E_stream_t *stream, const struct bio_vec *dict,
+	struct bvec_iter dictIter)
+{
+	LZ4E_stream_t_internal *ctx = &stream->internal_donotuse;
+	LZ4E_cursor_t cur;
+	U32 pos = 0;
+	U32 base;
+
+	LZ4E_resetStream(stream);
+
+	/* Keep positions of the dictionary away from index 0 */
+	ctx->currentOffset = 64 * KB;
+	ctx->tableType = (U32)byU32;
+
+	LZ4E_appendDict(ctx, dict, dictIter);
+
+	if (ctx->dictIter.bi_size < HASH_UNIT)
+		return ctx->dictIter.bi_size;
+
+	base = ctx->currentOffset - ctx->dictIter.bi_size;
+	cur = LZ4E_cur_init(ctx->dictVecs, ctx->dictIter);
+
+	for ( ; ; ) {
+		LZ4E_putPosition(ctx->dictVecs, &cur, base + pos,
+			ctx->hashTable, byU32);
+
+		if (pos + 3 + HASH_UNIT > ctx->dictIter.bi_size)
+			break;
+
+		LZ4E_advance(ctx->dictVecs, &cur, &pos, 3);
+	}
+
+	return ctx->dictIter.bi_size;
+}
+EXPORT_SYMBOL(LZ4E_loadDict);
+
+int LZ4E_saveDict(LZ4E_stream_t *stream, struct bio_vec *safeBuffer,
+	struct bvec_iter safeIter)
+{
+	LZ4E_stream_t_internal *ctx = &stream->internal_donotuse;
+	struct bvec_iter dictIter = ctx->dictIter;
+	U32 dictSize;
+
+	LZ4E_trimVecs(safeBuffer, &safeIter, LZ4E_SEG_MAX);
+	dictSize = min(dictIter.bi_size, safeIter.bi_size);
+
+	bvec_iter_advance(ctx->dictVecs, &dictIter,
+		dictIter.bi_size - dictSize);
+	safeIter.bi_size = dictSize;
+
+	LZ4E_memcpy(safeBuffer, ctx->dictVecs,
+		LZ4E_cur_init(safeBuffer, safeIter),
+		LZ4E_cur_init(ctx->dictVecs, dictIter), dictSize);
+
+	ctx->dictIter.bi_size = 0;
+	LZ4E_appendDict(ctx, safeBuffer, safeIter);
+
+	return dictSize;
+}
+EXPORT_SYMBOL(LZ4E_saveDict);
+
+int LZ4E_compress_fast_continue(LZ4E_stream_t *stream,
+	const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int acceleration)
+{
+	LZ4E_stream_t_internal *ctx = &stream->internal_donotuse;
+	const struct bvec_iter srcStart = *srcIter;
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int maxOutputSize = dstIter->bi_size;
+	int result;
+
+	if (acceleration < 1)
+		acceleration = LZ4E_ACCELERATION_DEFAULT;
+
+	if (acceleration > LZ4E_ACCELERATION_MAX)
+		acceleration = LZ4E_ACCELERATION_MAX;
+
+	/* The stream may have been used by the one-shot functions */
+	if ((tableType_t)ctx->tableType == byU16) {
+		const U32 favorDecSpeed = ctx->favorDecSpeed;
+		const U32 skipSameFilled = ctx->skipSameFilled;
+
+		LZ4E_resetStream(stream);
+		ctx->tableType = (U32)byU32;
+		ctx->favorDecSpeed = favorDecSpeed;
+		ctx->skipSameFilled = skipSameFilled;
+	}
+
+	LZ4E_renormDictT(ctx, inputSize);
+
+	if (!LZ4E_scanInput(ctx, src, srcStart))
+		return 0;
+
+	if (ctx->dictIter.bi_size == 0) {
+		if (maxOutputSize >= LZ4E_COMPRESSBOUND(inputSize))
+			result = LZ4E_compress_generic(ctx, src, dst,
+				srcIter, dstIter, noLimit, byU32, noDict,
+				(U32)acceleration, 0, NULL);
+		else
+			result = LZ4E_compress_generic(ctx, src, dst,
+				srcIter, dstIter, limitedOutput, byU32, noDict,
+				(U32)acceleration, 0, NULL);
+	} else {
+		if (maxOutputSize >= LZ4E_COMPRESSBOUND(inputSize))
+			result = LZ4E_compress_generic(ctx, src, dst,
+				srcIter, dstIter, noLimit, byU32, usingExtDict,
+				(U32)acceleration, 0, NULL);
+		else
+			result = LZ4E_compress_generic(ctx, src, dst,
+				srcIter, dstIter, limitedOutput, byU32,
+				usingExtDict, (U32)acceleration, 0, NULL);
+	}
+
+	if (result)
+		LZ4E_appendDict(ctx, src, srcStart);
+
+	return result;
+}
+EXPORT_SYMBOL(LZ4E_compress_fast_continue);
+
 MODULE_AUTHOR("Alexander Bugaev");
 MODULE_DESCRIPTION("LZ4 compression for scatter-gather buffers");
 MODULE_LICENSE("GPL");
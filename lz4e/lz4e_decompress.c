@@ -33,6 +33,8 @@
 /*-************************************
  *	Dependencies
  **************************************/
+#include <linux/bio.h>
+#include <linux/bvec.h>
 #include <linux/export.h>
 #include <linux/init.h>
 #include <linux/module.h>
@@ -110,6 +112,9 @@ static FORCE_INLINE int LZ4E_decompress_generic(
 	assert(src != NULL);
 
 	/* Empty output buffer */
+	if ((partialDecoding) && (unlikely(outputSize == 0)))
+		return 0;
+
 	if ((endOnInput) && (unlikely(outputSize == 0)))
 		return ((srcSize == 1) && (*ip == 0)) ? 0 : -1;
 
@@ -459,15 +464,588 @@ _output_error:
 	return (int) (-(((const char *)ip) - src)) - 1;
 }
 
-int LZ4E_decompress_safe(const char *source, char *dest,
-	int compressedSize, int maxDecompressedSize)
+/*
+ * LZ4E_decompress_bvec_generic() :
+ * Decodes a block from a scatter-gather source straight into
+ * a scatter-gather destination. Matches are copied from the already
+ * decoded part of the destination, reached by walking the bvecs back,
+ * or from the dictionary of 'dictPtr' when it is not NULL.
+ * Always bounded by the input size.
+ * With partial_decode, stops as soon as 'outputSize' bytes are decoded.
+ */
+static FORCE_INLINE int LZ4E_decompress_bvec_generic(
+	const struct bio_vec * const src,
+	struct bio_vec * const dst,
+	struct bvec_iter * const srcIter,
+	struct bvec_iter * const dstIter,
+	/* number of bytes to produce, at most the size of 'dstIter' */
+	const size_t outputSize,
+	/* full, partial */
+	const earlyEnd_directive partialDecoding,
+	/* checksum of the output, fed as it is decoded, or NULL */
+	struct xxh32_state * const xxh,
+	/* previously decoded data of a stream, or NULL */
+	const LZ4E_streamDecode_t_internal * const dictPtr)
+{
+	const size_t srcSize = srcIter->bi_size;
+	const size_t dictSize = dictPtr ? dictPtr->dictIter.bi_size : 0;
+	LZ4E_cursor_t ipCur = LZ4E_cur_init(src, *srcIter);
+	LZ4E_cursor_t opCur = LZ4E_cur_init(dst, *dstIter);
+	U32 ipPos = 0;
+	U32 opPos = 0;
+	/* Output before this position is fed to 'xxh' */
+	LZ4E_cursor_t hashCur = opCur;
+	U32 hashPos = 0;
+
+	/* Empty output buffer */
+	if (partialDecoding && unlikely(outputSize == 0))
+		return 0;
+
+	if (unlikely(outputSize == 0))
+		return ((srcSize == 1) && (LZ4E_read8(src, &ipCur) == 0))
+			? 0 : -1;
+
+	if (unlikely(srcSize == 0))
+		return -1;
+
+	/* Main Loop : decode sequences */
+	while (1) {
+		size_t length;
+		size_t offset;
+		unsigned int token;
+
+		/* get literal length */
+		token = LZ4E_read8(src, &ipCur);
+		LZ4E_advance1(src, &ipCur, &ipPos);
+		length = token >> ML_BITS;
+
+		if (length == RUN_MASK) {
+			unsigned int s;
+
+			do {
+				if (unlikely(ipPos >= srcSize))
+					goto _output_error;
+
+				s = LZ4E_read8(src, &ipCur);
+				LZ4E_advance1(src, &ipCur, &ipPos);
+				length += s;
+
+				/* literals can not be longer than the input */
+				if (unlikely(length > srcSize))
+					goto _output_error;
+			} while (s == 255);
+		}
+
+		/* copy literals */
+		if ((opPos + length + MFLIMIT > outputSize)
+			|| (ipPos + length + (2 + 1 + LASTLITERALS) > srcSize)) {
+			if (partialDecoding) {
+				/*
+				 * Partial decoding :
+				 * stop in the middle of literal segment
+				 */
+				if (opPos + length > outputSize)
+					length = outputSize - opPos;
+
+				/*
+				 * Error :
+				 * read attempt beyond end of input buffer
+				 */
+				if (ipPos + length > srcSize)
+					goto _output_error;
+			} else if ((ipPos + length != srcSize)
+				|| (opPos + length > outputSize)) {
+				/*
+				 * Error :
+				 * input must be consumed and must fit
+				 * into the output
+				 */
+				goto _output_error;
+			}
+
+			LZ4E_memcpy(dst, src, opCur, ipCur, length);
+			LZ4E_advance(src, &ipCur, &ipPos, length);
+			LZ4E_advance(dst, &opCur, &opPos, length);
+
+			/*
+			 * Necessarily EOF when !partialDecoding.
+			 * When partialDecoding, it is EOF if we've either
+			 * filled the output buffer or can't proceed with
+			 * reading an offset for following match.
+			 */
+			if (!partialDecoding || (opPos == outputSize)
+				|| (ipPos + 2 >= srcSize))
+				break;
+		} else {
+			LZ4E_memcpy(dst, src, opCur, ipCur, length);
+			LZ4E_advance(src, &ipCur, &ipPos, length);
+			LZ4E_advance(dst, &opCur, &opPos, length);
+		}
+
+		/* get offset */
+		offset = LZ4E_readLE16(src, &ipCur);
+		LZ4E_advance(src, &ipCur, &ipPos, 2);
+
+		/* Error : offset outside of the decoded data */
+		if (unlikely(offset == 0 || offset > opPos + dictSize))
+			goto _output_error;
+
+		/* get matchlength */
+		length = token & ML_MASK;
+
+		if (length == ML_MASK) {
+			unsigned int s;
+
+			do {
+				if (unlikely(ipPos + LASTLITERALS >= srcSize))
+					goto _output_error;
+
+				s = LZ4E_read8(src, &ipCur);
+				LZ4E_advance1(src, &ipCur, &ipPos);
+				length += s;
+
+				/* overflow detection */
+				if (unlikely(length > LZ4E_MAX_INPUT_SIZE))
+					goto _output_error;
+			} while (s == 255);
+		}
+
+		length += MINMATCH;
+
+		if (partialDecoding) {
+			/*
+			 * Partial decoding :
+			 * may not respect endBlock parsing restrictions
+			 */
+			length = min(length, outputSize - opPos);
+		} else if (unlikely(opPos + length + LASTLITERALS > outputSize)) {
+			/* Error : last LASTLITERALS bytes must be literals */
+			goto _output_error;
+		}
+
+		/* match starting in the dictionary */
+		if (dictPtr && offset > opPos) {
+			const size_t inDict = min(offset - opPos, length);
+			const LZ4E_cursor_t dictCur = LZ4E_cur_init(
+				dictPtr->dictVecs,
+				LZ4E_seg_iter(&dictPtr->dictSegTable,
+					dictPtr->dictIter,
+					(U32)(dictSize - (offset - opPos))));
+
+			LZ4E_memcpy(dst, dictPtr->dictVecs, opCur, dictCur,
+				inDict);
+			LZ4E_advance(dst, &opCur, &opPos, inDict);
+
+			/* the rest continues from the start of the output */
+			length -= inDict;
+		}
+
+		/* copy match within the decoded data */
+		if (length) {
+			LZ4E_cursor_t matchCur = LZ4E_cur_back(dst, &opCur,
+				(unsigned int)offset);
+
+			if (offset >= length) {
+				LZ4E_memcpy(dst, dst, opCur, matchCur, length);
+			} else {
+				/*
+				 * Overlapping match : the decoded part repeats
+				 * with period 'offset', so it is copied in
+				 * non-overlapping chunks doubling in size
+				 */
+				LZ4E_cursor_t cpyCur = opCur;
+				size_t done = 0;
+
+				while (done < length) {
+					const size_t chunk = min(offset + done,
+						length - done);
+
+					LZ4E_memcpy(dst, dst, cpyCur, matchCur,
+						chunk);
+					done += chunk;
+
+					if (done < length)
+						LZ4E_cur_advance(dst, &cpyCur,
+							(unsigned int)chunk);
+				}
+			}
+
+			LZ4E_advance(dst, &opCur, &opPos, length);
+		}
+
+		/* Hash decoded output in spans, while it is still in cache */
+		if (xxh && (opPos - hashPos >= LZ4E_XXH_SPAN)) {
+			LZ4E_xxh32_update(xxh, dst, hashCur, opPos - hashPos);
+			hashCur = opCur;
+			hashPos = opPos;
+		}
+
+		if (partialDecoding && (opPos == outputSize))
+			break;
+	}
+
+	if (xxh)
+		LZ4E_xxh32_update(xxh, dst, hashCur, opPos - hashPos);
+
+	*srcIter = ipCur.iter;
+	*dstIter = opCur.iter;
+
+	/* end of decoding */
+	return (int) opPos;
+
+	/* Overflow error detected */
+_output_error:
+	return (int) (-ipPos) - 1;
+}
+
+int LZ4E_decompress_safe(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter)
 {
+	return LZ4E_decompress_bvec_generic(src, dst, srcIter, dstIter,
+		dstIter->bi_size, decode_full_block, NULL, NULL);
+}
+EXPORT_SYMBOL(LZ4E_decompress_safe);
+
+int LZ4E_decompress_safe_partial(const struct bio_vec *src,
+	struct bio_vec *dst, struct bvec_iter *srcIter,
+	struct bvec_iter *dstIter, int targetOutputSize)
+{
+	const size_t outputSize = min_t(size_t, max(targetOutputSize, 0),
+		dstIter->bi_size);
+
+	return LZ4E_decompress_bvec_generic(src, dst, srcIter, dstIter,
+		outputSize, partial_decode, NULL, NULL);
+}
+EXPORT_SYMBOL(LZ4E_decompress_safe_partial);
+
+int LZ4E_decompress_safe_xxh32(const struct bio_vec *src,
+	struct bio_vec *dst, struct bvec_iter *srcIter,
+	struct bvec_iter *dstIter, const uint32_t *checksum)
+{
+	struct bvec_iter inIter = *srcIter;
+	struct bvec_iter outIter = *dstIter;
+	struct xxh32_state state;
+	int ret;
+
+	if (!checksum)
+		return LZ4E_decompress_safe(src, dst, srcIter, dstIter);
+
+	xxh32_reset(&state, 0);
+
+	ret = LZ4E_decompress_bvec_generic(src, dst, &inIter, &outIter,
+		outIter.bi_size, decode_full_block, &state, NULL);
+	if (ret < 0)
+		return ret;
+
+	/* Error : decoded data does not match the checksum */
+	if (xxh32_digest(&state) != *checksum)
+		return -(int)srcIter->bi_size - 1;
+
+	*srcIter = inIter;
+	*dstIter = outIter;
+
+	return ret;
+}
+EXPORT_SYMBOL(LZ4E_decompress_safe_xxh32);
+
+int LZ4E_decompress_safe_partial_flat(const char *source, char *dest,
+	int compressedSize, int targetOutputSize, int maxDecompressedSize)
+{
+	maxDecompressedSize = min(targetOutputSize, maxDecompressedSize);
+
 	return LZ4E_decompress_generic(source, dest,
 				      compressedSize, maxDecompressedSize,
-				      endOnInputSize, decode_full_block,
+				      endOnInputSize, partial_decode,
 				      noDict, (BYTE *)dest, NULL, 0);
 }
-EXPORT_SYMBOL(LZ4E_decompress_safe);
+EXPORT_SYMBOL(LZ4E_decompress_safe_partial_flat);
+
+/*
+ * Read a little-endian 32-bit field of the block index at 'iter'
+ */
+static U32 LZ4E_readBlocksField(const struct bio_vec *src,
+	struct bvec_iter *iter)
+{
+	BYTE field[4];
+
+	LZ4E_memcpy_from_sg((char *)field, src, *iter, sizeof(field));
+	bvec_iter_advance(src, iter, sizeof(field));
+
+	return get_unaligned_le32(field);
+}
+
+/*
+ * Read the input size of block-framed data and check that the whole index
+ * of block sizes is there, returns 0 on success
+ */
+static int LZ4E_readBlocksHeader(const struct bio_vec *src,
+	struct bvec_iter *fieldIter, U32 *inputSize)
+{
+	const unsigned int frameSize = fieldIter->bi_size;
+
+	if (frameSize < LZ4E_BLOCKS_HEADER_SIZE(0))
+		return -1;
+
+	*inputSize = LZ4E_readBlocksField(src, fieldIter);
+
+	if (*inputSize > LZ4E_MAX_INPUT_SIZE
+		|| frameSize < LZ4E_BLOCKS_HEADER_SIZE(
+			LZ4E_BLOCKS_COUNT(*inputSize)))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Decompress a single block, which has to fill exactly 'blockSize' bytes
+ */
+static int LZ4E_decompress_oneBlock(const struct bio_vec *src,
+	struct bio_vec *dst, struct bvec_iter blockSrc,
+	const struct bvec_iter *dstIter, const U32 compressedSize,
+	const U32 blockSize)
+{
+	struct bvec_iter blockDst = *dstIter;
+	int result;
+
+	if (compressedSize > blockSrc.bi_size)
+		return -1;
+
+	blockSrc.bi_size = compressedSize;
+	blockDst.bi_size = blockSize;
+
+	result = LZ4E_decompress_safe(src, dst, &blockSrc, &blockDst);
+
+	if (result >= 0 && (U32)result != blockSize)
+		return -1;
+
+	return result;
+}
+
+int LZ4E_decompress_blocks(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter)
+{
+	struct bvec_iter fieldIter = *srcIter;
+	struct bvec_iter blockSrc = *srcIter;
+	struct bvec_iter blockDst = *dstIter;
+	U32 inputSize;
+	U32 blocks;
+	U32 i;
+
+	if (LZ4E_readBlocksHeader(src, &fieldIter, &inputSize))
+		return -1;
+
+	if (dstIter->bi_size < inputSize)
+		return -1;
+
+	blocks = LZ4E_BLOCKS_COUNT(inputSize);
+	bvec_iter_advance(src, &blockSrc, LZ4E_BLOCKS_HEADER_SIZE(blocks));
+
+	for (i = 0; i < blocks; i++) {
+		const U32 compressedSize = LZ4E_readBlocksField(src,
+			&fieldIter);
+		const U32 blockSize = min_t(U32, inputSize - i * LZ4E_BLOCK_SIZE,
+			LZ4E_BLOCK_SIZE);
+		const int result = LZ4E_decompress_oneBlock(src, dst,
+			blockSrc, &blockDst, compressedSize, blockSize);
+
+		if (result < 0)
+			return result;
+
+		bvec_iter_advance(src, &blockSrc, compressedSize);
+		bvec_iter_advance(dst, &blockDst, blockSize);
+	}
+
+	*srcIter = blockSrc;
+	*dstIter = blockDst;
+
+	return (int)inputSize;
+}
+EXPORT_SYMBOL(LZ4E_decompress_blocks);
+
+int LZ4E_decompress_block(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	unsigned int blockIdx)
+{
+	struct bvec_iter fieldIter = *srcIter;
+	struct bvec_iter blockSrc = *srcIter;
+	U32 inputSize;
+	U32 compressedSize;
+	U32 blockSize;
+	U32 offset;
+	U32 i;
+	int result;
+
+	if (LZ4E_readBlocksHeader(src, &fieldIter, &inputSize))
+		return -1;
+
+	if (blockIdx >= LZ4E_BLOCKS_COUNT(inputSize))
+		return -1;
+
+	offset = LZ4E_BLOCKS_HEADER_SIZE(LZ4E_BLOCKS_COUNT(inputSize));
+
+	/* Blocks before the requested one are skipped by their sizes */
+	for (i = 0; i < blockIdx; i++) {
+		compressedSize = LZ4E_readBlocksField(src, &fieldIter);
+
+		if (compressedSize > srcIter->bi_size - offset)
+			return -1;
+
+		offset += compressedSize;
+	}
+
+	compressedSize = LZ4E_readBlocksField(src, &fieldIter);
+	blockSize = min_t(U32, inputSize - blockIdx * LZ4E_BLOCK_SIZE,
+		LZ4E_BLOCK_SIZE);
+
+	if (dstIter->bi_size < blockSize)
+		return -1;
+
+	bvec_iter_advance(src, &blockSrc, offset);
+
+	result = LZ4E_decompress_oneBlock(src, dst, blockSrc, dstIter,
+		compressedSize, blockSize);
+
+	if (result < 0)
+		return result;
+
+	bvec_iter_advance(src, &blockSrc, compressedSize);
+	bvec_iter_advance(dst, dstIter, blockSize);
+	*srcIter = blockSrc;
+
+	return result;
+}
+EXPORT_SYMBOL(LZ4E_decompress_block);
+
+int LZ4E_setStreamDecode(LZ4E_streamDecode_t *streamDecode,
+	const struct bio_vec *dict, struct bvec_iter dictIter)
+{
+	LZ4E_streamDecode_t_internal *lz4sd =
+		&streamDecode->internal_donotuse;
+
+	LZ4_STATIC_ASSERT(sizeof(LZ4E_streamDecode_t_internal)
+		<= LZ4E_STREAMDECODESIZE_U64 * sizeof(unsigned long long));
+
+	memset(streamDecode, 0, sizeof(*streamDecode));
+	LZ4E_appendVecs(lz4sd->dictVecs, &lz4sd->dictIter,
+		&lz4sd->dictSegTable, dict, dictIter);
+	return 1;
+}
+EXPORT_SYMBOL(LZ4E_setStreamDecode);
+
+/*
+ * Matches reaching before the start of the block are copied from the
+ * descriptors of the previously decoded data, so the blocks of a stream
+ * may be decoded into unrelated pages.
+ */
+int LZ4E_decompress_safe_continue(LZ4E_streamDecode_t *streamDecode,
+	const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter)
+{
+	LZ4E_streamDecode_t_internal *lz4sd =
+		&streamDecode->internal_donotuse;
+	struct bvec_iter outIter = *dstIter;
+	int result;
+
+	if (lz4sd->dictIter.bi_size == 0)
+		result = LZ4E_decompress_bvec_generic(src, dst, srcIter,
+			dstIter, dstIter->bi_size, decode_full_block,
+			NULL, NULL);
+	else
+		result = LZ4E_decompress_bvec_generic(src, dst, srcIter,
+			dstIter, dstIter->bi_size, decode_full_block,
+			NULL, lz4sd);
+
+	if (result <= 0)
+		return result;
+
+	/* The decoded block becomes the end of the dictionary */
+	outIter.bi_size = result;
+	LZ4E_appendVecs(lz4sd->dictVecs, &lz4sd->dictIter,
+		&lz4sd->dictSegTable, dst, outIter);
+
+	return result;
+}
+EXPORT_SYMBOL(LZ4E_decompress_safe_continue);
+
+int LZ4E_setStreamDecode_flat(LZ4E_streamDecodeFlat_t *streamDecode,
+	const char *dictionary, int dictSize)
+{
+	LZ4E_streamDecodeFlat_t_internal *lz4sd =
+		&streamDecode->internal_donotuse;
+
+	lz4sd->prefixSize = (size_t) dictSize;
+	lz4sd->prefixEnd = (const BYTE *) dictionary + dictSize;
+	lz4sd->externalDict = NULL;
+	lz4sd->extDictSize = 0;
+	return 1;
+}
+EXPORT_SYMBOL(LZ4E_setStreamDecode_flat);
+
+/*
+ * Previously decoded data must stay available at its location:
+ * either right before 'dest' when the same buffer is rolled,
+ * or in the buffer of the previous call, which becomes the
+ * external dictionary.
+ */
+int LZ4E_decompress_safe_continue_flat(
+	LZ4E_streamDecodeFlat_t *streamDecode, const char *source, char *dest, int compressedSize, int maxOutputSize)
+{
+	LZ4E_streamDecodeFlat_t_internal *lz4sd =
+		&streamDecode->internal_donotuse;
+	int result;
+
+	if (lz4sd->prefixSize == 0) {
+		/* The first call, no dictionary yet. */
+		result = LZ4E_decompress_generic(source, dest,
+			compressedSize, maxOutputSize,
+			endOnInputSize, decode_full_block,
+			noDict, (BYTE *)dest, NULL, 0);
+		if (result <= 0)
+			return result;
+		lz4sd->prefixSize = result;
+		lz4sd->prefixEnd = (BYTE *)dest + result;
+	} else if (lz4sd->prefixEnd == (BYTE *)dest) {
+		/* They're rolling the current segment. */
+		if (lz4sd->prefixSize >= 64 * KB - 1)
+			result = LZ4E_decompress_generic(source, dest,
+				compressedSize, maxOutputSize,
+				endOnInputSize, decode_full_block,
+				withPrefix64k, (BYTE *)dest - 64 * KB,
+				NULL, 0);
+		else if (lz4sd->extDictSize == 0)
+			result = LZ4E_decompress_generic(source, dest,
+				compressedSize, maxOutputSize,
+				endOnInputSize, decode_full_block,
+				noDict, (BYTE *)dest - lz4sd->prefixSize,
+				NULL, 0);
+		else
+			result = LZ4E_decompress_generic(source, dest,
+				compressedSize, maxOutputSize,
+				endOnInputSize, decode_full_block,
+				usingExtDict, (BYTE *)dest - lz4sd->prefixSize,
+				lz4sd->externalDict, lz4sd->extDictSize);
+		if (result <= 0)
+			return result;
+		lz4sd->prefixSize += result;
+		lz4sd->prefixEnd  += result;
+	} else {
+		/* The buffer wraps around, or they're switching to another buffer. */
+		lz4sd->extDictSize = lz4sd->prefixSize;
+		lz4sd->externalDict = lz4sd->prefixEnd - lz4sd->extDictSize;
+		result = LZ4E_decompress_generic(source, dest,
+			compressedSize, maxOutputSize,
+			endOnInputSize, decode_full_block,
+			usingExtDict, (BYTE *)dest,
+			lz4sd->externalDict, lz4sd->extDictSize);
+		if (result <= 0)
+			return result;
+		lz4sd->prefixSize = result;
+		lz4sd->prefixEnd  = (BYTE *)dest + result;
+	}
+
+	return result;
+}
+EXPORT_SYMBOL(LZ4E_decompress_safe_continue_flat);
 
 MODULE_AUTHOR("");
 MODULE_DESCRIPTION("LZ4 decompression for scatter-gather buffers");
@@ -0,0 +1,545 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * KUnit suite for the bvec primitives of lz4e_defs.h. Every case checks
+ * a primitive against the same operation on a linear copy of the buffer,
+ * then times it and reports ns/op, so that changes to the primitives can
+ * be measured on their own. The buffers are split into segments in
+ * several ways, a single segment being the baseline of the others.
+ */
+
+#include <kunit/test.h>
+#include <linux/bvec.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/prandom.h>
+#include <linux/string.h>
+
+#include "include/lz4e.h"
+#include "include/lz4e_defs.h"
+
+#define LZ4E_KUNIT_SIZE (8 * KB)
+
+/* Backing memory of a buffer, enough for LZ4E_SEG_MAX fragments */
+#define LZ4E_KUNIT_MEM_SIZE (LZ4E_SEG_MAX / 4 * PAGE_SIZE)
+
+/* Positions the primitives are timed at */
+#define LZ4E_KUNIT_POINTS 128
+
+/* Times every timed loop is repeated */
+#define LZ4E_KUNIT_ROUNDS 256
+
+#define LZ4E_KUNIT_SEED 0x6c7a3465ULL
+
+/* Byte the destination of copies is filled with beforehand */
+#define LZ4E_KUNIT_POISON 0xAA
+
+enum lz4e_kunit_layout {
+	LZ4E_KUNIT_SINGLE,	/* one segment over contiguous pages */
+	LZ4E_KUNIT_MISALIGNED,	/* one per page at an odd offset */
+	LZ4E_KUNIT_FRAGS,	/* short fragments, none adjacent in memory */
+};
+
+static const enum lz4e_kunit_layout lz4e_kunit_layouts[] = {
+	LZ4E_KUNIT_SINGLE,
+	LZ4E_KUNIT_MISALIGNED,
+	LZ4E_KUNIT_FRAGS,
+};
+
+static const char *const lz4e_kunit_layout_names[] = {
+	[LZ4E_KUNIT_SINGLE] = "single",
+	[LZ4E_KUNIT_MISALIGNED] = "misaligned",
+	[LZ4E_KUNIT_FRAGS] = "fragments",
+};
+
+/* Fragment lengths, taken in turn */
+static const unsigned int lz4e_kunit_frag_lens[] = {
+	1, 2, 3, 5, 8, 13, 21, 64, 511
+};
+
+/*
+ * Buffer split into segments, along with a linear copy of its contents
+ */
+struct lz4e_kunit_buf {
+	BYTE *mem;
+	BYTE *ref;
+	struct bio_vec bvecs[LZ4E_SEG_MAX];
+	unsigned int count;
+};
+
+static void lz4e_kunit_layout_desc(const enum lz4e_kunit_layout *layout,
+	char *desc)
+{
+	strscpy(desc, lz4e_kunit_layout_names[*layout], KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(lz4e_kunit_layout, lz4e_kunit_layouts,
+	lz4e_kunit_layout_desc);
+
+/*
+ * Describe LZ4E_KUNIT_SIZE bytes of backing memory as segments.
+ * Fragments lie in the quarters of the pages at varying offsets, so that
+ * none of them ends where the next one starts.
+ */
+static void lz4e_kunit_split(struct kunit *test, struct lz4e_kunit_buf *buf,
+	enum lz4e_kunit_layout layout)
+{
+	unsigned int pos = 0;
+	unsigned int i;
+
+	for (i = 0; pos < LZ4E_KUNIT_SIZE; i++) {
+		unsigned int offset = 0;
+		unsigned int len = LZ4E_KUNIT_SIZE;
+
+		if (layout == LZ4E_KUNIT_MISALIGNED) {
+			offset = i * PAGE_SIZE + 1 + 2 * (i % 32);
+			len = PAGE_SIZE - offset % PAGE_SIZE;
+		} else if (layout == LZ4E_KUNIT_FRAGS) {
+			offset = i / 4 * PAGE_SIZE + i % 4 * (PAGE_SIZE / 4)
+				+ 1 + (i * 97) % (PAGE_SIZE / 16);
+			len = lz4e_kunit_frag_lens[i %
+				ARRAY_SIZE(lz4e_kunit_frag_lens)];
+		}
+
+		len = min(len, LZ4E_KUNIT_SIZE - pos);
+
+		KUNIT_ASSERT_LT(test, i, LZ4E_SEG_MAX);
+		KUNIT_ASSERT_LE(test, offset + len, LZ4E_KUNIT_MEM_SIZE);
+
+		bvec_set_virt(&buf->bvecs[i], buf->mem + offset, len);
+		pos += len;
+	}
+
+	buf->count = i;
+}
+
+/*
+ * Buffers live on the heap, their bvec arrays are too large for the stack
+ */
+static struct lz4e_kunit_buf *lz4e_kunit_buf_alloc(struct kunit *test,
+	enum lz4e_kunit_layout layout)
+{
+	struct lz4e_kunit_buf *buf;
+
+	buf = kunit_kzalloc(test, sizeof(*buf), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+
+	buf->mem = kunit_kzalloc(test, LZ4E_KUNIT_MEM_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, buf->mem);
+
+	buf->ref = kunit_kzalloc(test, LZ4E_KUNIT_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, buf->ref);
+
+	lz4e_kunit_split(test, buf, layout);
+	return buf;
+}
+
+static struct bvec_iter lz4e_kunit_iter(const struct lz4e_kunit_buf *buf,
+	unsigned int pos)
+{
+	struct bvec_iter iter = { .bi_size = LZ4E_KUNIT_SIZE };
+
+	bvec_iter_advance(buf->bvecs, &iter, pos);
+	return iter;
+}
+
+static LZ4E_cursor_t lz4e_kunit_cur(const struct lz4e_kunit_buf *buf,
+	unsigned int pos)
+{
+	return LZ4E_cur_init(buf->bvecs, lz4e_kunit_iter(buf, pos));
+}
+
+static BYTE lz4e_kunit_byte(const struct lz4e_kunit_buf *buf,
+	struct bvec_iter iter)
+{
+	struct bio_vec bv = bvec_iter_bvec(buf->bvecs, iter);
+
+	return *((BYTE *)bvec_virt(&bv));
+}
+
+/* Copy the linear contents into the segments */
+static void lz4e_kunit_scatter(struct lz4e_kunit_buf *buf)
+{
+	struct bvec_iter start = { .bi_size = LZ4E_KUNIT_SIZE };
+	struct bvec_iter iter;
+	struct bio_vec bv;
+	BYTE *ref = buf->ref;
+
+	for_each_bvec(bv, buf->bvecs, iter, start) {
+		memcpy(bvec_virt(&bv), ref, bv.bv_len);
+		ref += bv.bv_len;
+	}
+}
+
+/* Copy the segments into the linear contents */
+static void lz4e_kunit_gather(struct lz4e_kunit_buf *buf)
+{
+	struct bvec_iter start = { .bi_size = LZ4E_KUNIT_SIZE };
+	struct bvec_iter iter;
+	struct bio_vec bv;
+	BYTE *ref = buf->ref;
+
+	for_each_bvec(bv, buf->bvecs, iter, start) {
+		memcpy(ref, bvec_virt(&bv), bv.bv_len);
+		ref += bv.bv_len;
+	}
+}
+
+/*
+ * Runs of a short repeated pattern between random bytes,
+ * so that matches of any length up to a few hundred bytes occur
+ */
+static void lz4e_kunit_fill(struct lz4e_kunit_buf *buf)
+{
+	struct rnd_state rnd;
+	unsigned int pos = 0;
+
+	prandom_seed_state(&rnd, LZ4E_KUNIT_SEED);
+
+	while (pos < LZ4E_KUNIT_SIZE) {
+		const u32 r = prandom_u32_state(&rnd);
+		unsigned int len = min(1 + (r & 0x1ff), LZ4E_KUNIT_SIZE - pos);
+		unsigned int i;
+
+		if (r >> 31) {
+			prandom_bytes_state(&rnd, buf->ref + pos, len);
+		} else {
+			for (i = 0; i < len; i++)
+				buf->ref[pos + i] = "abc"[i % 3];
+		}
+
+		pos += len;
+	}
+
+	lz4e_kunit_scatter(buf);
+}
+
+/* Spread over the buffer, not aligned to anything and never at its start */
+static unsigned int lz4e_kunit_point(unsigned int i, unsigned int tail)
+{
+	return i * ((LZ4E_KUNIT_SIZE - tail) / LZ4E_KUNIT_POINTS) + 1 + i % 7;
+}
+
+static void lz4e_kunit_report(struct kunit *test, const char *name,
+	u64 ns, u64 ops)
+{
+	const u64 ps = div64_u64(ns * 1000, max_t(u64, ops, 1));
+
+	kunit_info(test, "%s: %llu.%03llu ns/op\n", name,
+		div_u64(ps, 1000), ps % 1000);
+}
+
+static void lz4e_kunit_iter_advance1(struct kunit *test)
+{
+	const enum lz4e_kunit_layout *layout = test->param_value;
+	struct lz4e_kunit_buf *buf;
+	struct bvec_iter iter = { .bi_size = LZ4E_KUNIT_SIZE };
+	unsigned int pos;
+	unsigned int round;
+	u64 start;
+
+	buf = lz4e_kunit_buf_alloc(test, *layout);
+	lz4e_kunit_fill(buf);
+
+	for (pos = 0; pos < LZ4E_KUNIT_SIZE; pos++) {
+		KUNIT_ASSERT_EQ(test, iter.bi_size, LZ4E_KUNIT_SIZE - pos);
+		KUNIT_ASSERT_EQ(test, lz4e_kunit_byte(buf, iter),
+			buf->ref[pos]);
+
+		LZ4E_iter_advance1(buf->bvecs, &iter);
+	}
+
+	KUNIT_EXPECT_EQ(test, iter.bi_size, 0);
+	KUNIT_EXPECT_EQ(test, iter.bi_idx, buf->count);
+
+	start = ktime_get_ns();
+
+	for (round = 0; round < LZ4E_KUNIT_ROUNDS; round++) {
+		iter = (struct bvec_iter){ .bi_size = LZ4E_KUNIT_SIZE };
+
+		for (pos = 0; pos < LZ4E_KUNIT_SIZE; pos++)
+			LZ4E_iter_advance1(buf->bvecs, &iter);
+
+		OPTIMIZER_HIDE_VAR(iter.bi_idx);
+	}
+
+	lz4e_kunit_report(test, "LZ4E_iter_advance1", ktime_get_ns() - start,
+		(u64)LZ4E_KUNIT_ROUNDS * LZ4E_KUNIT_SIZE);
+}
+
+static void lz4e_kunit_iter_rollback1(struct kunit *test)
+{
+	const enum lz4e_kunit_layout *layout = test->param_value;
+	struct lz4e_kunit_buf *buf;
+	struct bvec_iter iter;
+	unsigned int pos;
+	unsigned int round;
+	u64 start;
+
+	buf = lz4e_kunit_buf_alloc(test, *layout);
+	lz4e_kunit_fill(buf);
+
+	/* Past the end, where LZ4E_iter_advance1 leaves the iterator */
+	iter = (struct bvec_iter){ .bi_idx = buf->count };
+
+	for (pos = LZ4E_KUNIT_SIZE; pos > 0; pos--) {
+		LZ4E_iter_rollback1(buf->bvecs, &iter);
+
+		KUNIT_ASSERT_EQ(test, iter.bi_size, LZ4E_KUNIT_SIZE - pos + 1);
+		KUNIT_ASSERT_EQ(test, lz4e_kunit_byte(buf, iter),
+			buf->ref[pos - 1]);
+	}
+
+	KUNIT_EXPECT_EQ(test, iter.bi_idx, 0);
+	KUNIT_EXPECT_EQ(test, iter.bi_bvec_done, 0);
+
+	start = ktime_get_ns();
+
+	for (round = 0; round < LZ4E_KUNIT_ROUNDS; round++) {
+		iter = (struct bvec_iter){ .bi_idx = buf->count };
+
+		for (pos = 0; pos < LZ4E_KUNIT_SIZE; pos++)
+			LZ4E_iter_rollback1(buf->bvecs, &iter);
+
+		OPTIMIZER_HIDE_VAR(iter.bi_idx);
+	}
+
+	lz4e_kunit_report(test, "LZ4E_iter_rollback1", ktime_get_ns() - start,
+		(u64)LZ4E_KUNIT_ROUNDS * LZ4E_KUNIT_SIZE);
+}
+
+/*
+ * Cursors at LZ4E_KUNIT_POINTS positions, each followed by
+ * at least 'tail' bytes of the buffer
+ */
+static LZ4E_cursor_t *lz4e_kunit_points(struct kunit *test,
+	const struct lz4e_kunit_buf *buf, unsigned int tail)
+{
+	LZ4E_cursor_t *curs;
+	unsigned int i;
+
+	curs = kunit_kmalloc_array(test, LZ4E_KUNIT_POINTS, sizeof(*curs),
+		GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, curs);
+
+	for (i = 0; i < LZ4E_KUNIT_POINTS; i++)
+		curs[i] = lz4e_kunit_cur(buf, lz4e_kunit_point(i, tail));
+
+	return curs;
+}
+
+static void lz4e_kunit_read32(struct kunit *test)
+{
+	const enum lz4e_kunit_layout *layout = test->param_value;
+	struct lz4e_kunit_buf *buf;
+	LZ4E_cursor_t *curs;
+	LZ4E_cursor_t cur;
+	unsigned int pos;
+	unsigned int round;
+	unsigned int i;
+	u64 expected = 0;
+	u64 sum = 0;
+	u64 start;
+
+	buf = lz4e_kunit_buf_alloc(test, *layout);
+	lz4e_kunit_fill(buf);
+
+	/* Every position, including the reads straddling segments */
+	cur = lz4e_kunit_cur(buf, 0);
+
+	for (pos = 0; pos + 4 <= LZ4E_KUNIT_SIZE; pos++) {
+		KUNIT_ASSERT_EQ(test, LZ4E_read32(buf->bvecs, &cur),
+			LZ4_read32(buf->ref + pos));
+
+		LZ4E_cur_advance(buf->bvecs, &cur, 1);
+	}
+
+	curs = lz4e_kunit_points(test, buf, 4);
+
+	for (i = 0; i < LZ4E_KUNIT_POINTS; i++)
+		expected += LZ4_read32(buf->ref + lz4e_kunit_point(i, 4));
+
+	start = ktime_get_ns();
+
+	for (round = 0; round < LZ4E_KUNIT_ROUNDS; round++) {
+		for (i = 0; i < LZ4E_KUNIT_POINTS; i++)
+			sum += LZ4E_read32(buf->bvecs, &curs[i]);
+	}
+
+	lz4e_kunit_report(test, "LZ4E_read32", ktime_get_ns() - start,
+		(u64)LZ4E_KUNIT_ROUNDS * LZ4E_KUNIT_POINTS);
+
+	KUNIT_EXPECT_EQ(test, sum, expected * LZ4E_KUNIT_ROUNDS);
+}
+
+static unsigned int lz4e_kunit_count_ref(const BYTE *in, const BYTE *match,
+	unsigned int limit)
+{
+	unsigned int count = 0;
+
+	while (count < limit && in[count] == match[count])
+		count++;
+
+	return count;
+}
+
+static void lz4e_kunit_count(struct kunit *test)
+{
+	/* From overlapping matches of the pattern to far ones */
+	static const unsigned int offsets[] = { 1, 3, 8, 64, 1000, 4099 };
+	const enum lz4e_kunit_layout *layout = test->param_value;
+	struct lz4e_kunit_buf *buf;
+	LZ4E_cursor_t *inCurs;
+	LZ4E_cursor_t *matchCurs;
+	unsigned int round;
+	unsigned int i;
+	unsigned int j;
+	u64 expected = 0;
+	u64 sum = 0;
+	u64 start;
+
+	buf = lz4e_kunit_buf_alloc(test, *layout);
+	lz4e_kunit_fill(buf);
+
+	for (j = 0; j < ARRAY_SIZE(offsets); j++) {
+		for (i = 0; i < LZ4E_KUNIT_POINTS; i++) {
+			const unsigned int matchPos =
+				lz4e_kunit_point(i, offsets[j] + 1);
+			const unsigned int inPos = matchPos + offsets[j];
+			const unsigned int limit = LZ4E_KUNIT_SIZE - inPos;
+			const LZ4E_cursor_t inCur = lz4e_kunit_cur(buf, inPos);
+			const LZ4E_cursor_t matchCur =
+				lz4e_kunit_cur(buf, matchPos);
+
+			KUNIT_ASSERT_EQ(test,
+				LZ4E_count(buf->bvecs, inCur, buf->bvecs,
+					matchCur, limit),
+				lz4e_kunit_count_ref(buf->ref + inPos,
+					buf->ref + matchPos, limit));
+		}
+	}
+
+	/* Timed at the period of the pattern, where matches are long */
+	matchCurs = lz4e_kunit_points(test, buf, 4);
+	inCurs = kunit_kmalloc_array(test, LZ4E_KUNIT_POINTS, sizeof(*inCurs),
+		GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, inCurs);
+
+	for (i = 0; i < LZ4E_KUNIT_POINTS; i++) {
+		const unsigned int matchPos = lz4e_kunit_point(i, 4);
+
+		inCurs[i] = lz4e_kunit_cur(buf, matchPos + 3);
+		expected += lz4e_kunit_count_ref(buf->ref + matchPos + 3,
+			buf->ref + matchPos, LZ4E_KUNIT_SIZE - matchPos - 3);
+	}
+
+	start = ktime_get_ns();
+
+	for (round = 0; round < LZ4E_KUNIT_ROUNDS; round++) {
+		for (i = 0; i < LZ4E_KUNIT_POINTS; i++)
+			sum += LZ4E_count(buf->bvecs, inCurs[i], buf->bvecs,
+				matchCurs[i], inCurs[i].iter.bi_size);
+	}
+
+	lz4e_kunit_report(test, "LZ4E_count", ktime_get_ns() - start,
+		(u64)LZ4E_KUNIT_ROUNDS * LZ4E_KUNIT_POINTS);
+	kunit_info(test, "LZ4E_count: %llu bytes/op\n",
+		div_u64(expected, LZ4E_KUNIT_POINTS));
+
+	KUNIT_EXPECT_EQ(test, sum, expected * LZ4E_KUNIT_ROUNDS);
+}
+
+static void lz4e_kunit_wild_copy(struct kunit *test)
+{
+	/* Up to a word, which takes the single move, and longer ones */
+	static const unsigned int lens[] = { 1, 4, 7, 8, 9, 16, 33, 600 };
+	const enum lz4e_kunit_layout *layout = test->param_value;
+	const unsigned int tail = 600 + WILDCOPYLENGTH;
+	struct lz4e_kunit_buf *src;
+	struct lz4e_kunit_buf *dst;
+	LZ4E_cursor_t *srcCurs;
+	LZ4E_cursor_t *dstCurs;
+	unsigned int round;
+	unsigned int i;
+	unsigned int j;
+	u64 start;
+
+	src = lz4e_kunit_buf_alloc(test, *layout);
+	dst = lz4e_kunit_buf_alloc(test, *layout);
+	lz4e_kunit_fill(src);
+
+	for (j = 0; j < ARRAY_SIZE(lens); j++) {
+		for (i = 0; i < LZ4E_KUNIT_POINTS; i += 8) {
+			/* Copies go to the other end of the buffer */
+			const unsigned int k = LZ4E_KUNIT_POINTS - 1 - i;
+			const unsigned int srcPos = lz4e_kunit_point(i, tail);
+			const unsigned int dstPos = lz4e_kunit_point(k, tail);
+			const unsigned int end = dstPos
+				+ max_t(unsigned int, lens[j], WILDCOPYLENGTH);
+
+			memset(dst->mem, LZ4E_KUNIT_POISON,
+				LZ4E_KUNIT_MEM_SIZE);
+
+			LZ4E_wildCopy(dst->bvecs, src->bvecs,
+				lz4e_kunit_cur(dst, dstPos),
+				lz4e_kunit_cur(src, srcPos), lens[j]);
+
+			lz4e_kunit_gather(dst);
+
+			KUNIT_ASSERT_MEMEQ(test, dst->ref + dstPos,
+				src->ref + srcPos, lens[j]);
+			/* Nothing is written before the start or past a word */
+			KUNIT_ASSERT_EQ(test, dst->ref[dstPos - 1],
+				LZ4E_KUNIT_POISON);
+			KUNIT_ASSERT_EQ(test, dst->ref[end], LZ4E_KUNIT_POISON);
+		}
+	}
+
+	srcCurs = lz4e_kunit_points(test, src, tail);
+	dstCurs = lz4e_kunit_points(test, dst, tail);
+
+	for (j = 0; j < ARRAY_SIZE(lens); j++) {
+		char name[32];
+
+		start = ktime_get_ns();
+
+		for (round = 0; round < LZ4E_KUNIT_ROUNDS; round++) {
+			for (i = 0; i < LZ4E_KUNIT_POINTS; i++)
+				LZ4E_wildCopy(dst->bvecs, src->bvecs,
+					dstCurs[i], srcCurs[i], lens[j]);
+		}
+
+		snprintf(name, sizeof(name), "LZ4E_wildCopy(%u)", lens[j]);
+		lz4e_kunit_report(test, name, ktime_get_ns() - start,
+			(u64)LZ4E_KUNIT_ROUNDS * LZ4E_KUNIT_POINTS);
+	}
+}
+
+static struct kunit_case lz4e_defs_cases[] = {
+	KUNIT_CASE_PARAM(lz4e_kunit_iter_advance1,
+		lz4e_kunit_layout_gen_params),
+	KUNIT_CASE_PARAM(lz4e_kunit_iter_rollback1,
+		lz4e_kunit_layout_gen_params),
+	KUNIT_CASE_PARAM(lz4e_kunit_read32, lz4e_kunit_layout_gen_params),
+	KUNIT_CASE_PARAM(lz4e_kunit_count, lz4e_kunit_layout_gen_params),
+	KUNIT_CASE_PARAM(lz4e_kunit_wild_copy, lz4e_kunit_layout_gen_params),
+	{}
+};
+
+static struct kunit_suite lz4e_defs_suite = {
+	.name = "lz4e_defs",
+	.test_cases = lz4e_defs_cases,
+};
+
+kunit_test_suite(lz4e_defs_suite);
+
+MODULE_AUTHOR("Alexander Bugaev");
+MODULE_DESCRIPTION("KUnit tests and timings of the bvec primitives of LZ4E");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,743 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ * Copyright (C) 2011 - 2016, Yann Collet.
+ * BSD 2 - Clause License (http://www.opensource.org/licenses/bsd - license.php)
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *	* Redistributions of source code must retain the above copyright
+ *	  notice, this list of conditions and the following disclaimer.
+ *	* Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * You can contact the author at :
+ *	- LZ4 homepage : http://www.lz4.org
+ *	- LZ4 source repository : https://github.com/lz4/lz4
+ *
+ *	Changed for kernel usage by:
+ *	Sven Schmidt <4sschmid@informatik.uni-hamburg.de>
+ */
+
+
+/*-************************************
+ *	Dependencies
+ **************************************/
+#include <linux/bio.h>
+#include <linux/bvec.h>
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+
+#include "include/lz4e.h"
+#include "include/lz4e_defs.h"
+
+/*-************************************
+ *	Local Constants
+ **************************************/
+#define OPTIMAL_ML (int)((ML_MASK - 1) + MINMATCH)
+
+/*-************************************
+ *	HC Compression
+ **************************************/
+static FORCE_INLINE U32 LZ4E_HC_hash(const U32 sequence)
+{
+	return (sequence * 2654435761U) >> ((MINMATCH * 8) - LZ4E_HC_HASH_LOG);
+}
+
+/*
+ * Update chains up to the given index. 'insCur' points at
+ * the position of ctx->nextToUpdate and is moved along with it.
+ */
+static FORCE_INLINE void LZ4E_HC_insert(
+	LZ4E_streamHC_t_internal *ctx,
+	const struct bio_vec *src,
+	LZ4E_cursor_t *insCur,
+	const U32 target)
+{
+	U16 * const chainTable = ctx->chainTable;
+	U32 * const hashTable = ctx->hashTable;
+	U32 idx = ctx->nextToUpdate;
+
+	/* The search may step back after a cut match, keep 'insCur' in place */
+	if (target <= idx)
+		return;
+
+	while (idx < target) {
+		U32 const h = LZ4E_HC_hash(LZ4E_read32(src, insCur));
+		size_t delta = idx - hashTable[h];
+
+		if (delta > MAX_DISTANCE)
+			delta = MAX_DISTANCE;
+
+		chainTable[idx & LZ4E_HC_MAXD_MASK] = (U16)delta;
+		hashTable[h] = idx;
+
+		idx++;
+		LZ4E_cur_advance(src, insCur, 1);
+	}
+
+	ctx->nextToUpdate = target;
+}
+
+/*
+ * Compare bytes at distance 'n' from both cursors. A candidate differing
+ * there cannot be longer than 'n', so it is skipped without counting.
+ * Bytes outside of mapped segments are not checked.
+ */
+static FORCE_INLINE bool LZ4E_HC_mayBeLonger(
+	const LZ4E_cursor_t *ipCur,
+	const LZ4E_cursor_t *matchCur,
+	const unsigned int n)
+{
+	if (likely(n < ipCur->left && n < matchCur->left))
+		return ipCur->ptr[n] == matchCur->ptr[n];
+
+	return true;
+}
+
+static FORCE_INLINE int LZ4E_HC_insertAndFindBestMatch(
+	LZ4E_streamHC_t_internal *ctx,
+	const struct bio_vec *src,
+	const struct bvec_iter srcStart,
+	LZ4E_cursor_t *insCur,
+	const U32 startIndex,
+	const LZ4E_cursor_t *ipCur,
+	const U32 ipPos,
+	const U32 matchlimit,
+	U32 *matchPos,
+	const int maxNbAttempts)
+{
+	U16 * const chainTable = ctx->chainTable;
+	U32 * const hashTable = ctx->hashTable;
+	const U32 ipIndex = startIndex + ipPos;
+	const U32 lowLimit = (startIndex + MAX_DISTANCE > ipIndex)
+		? startIndex
+		: ipIndex - MAX_DISTANCE;
+	/* Matches closer than this are skipped, see LZ4E_DEC_SPEED_OFFSET */
+	const U32 minOffset = ctx->favorDecSpeed ? LZ4E_DEC_SPEED_OFFSET : 1;
+	const U32 ipSeq = LZ4E_read32(src, ipCur);
+	LZ4E_cursor_t ipNextCur = *ipCur;
+	int nbAttempts = maxNbAttempts;
+	int ml = 0;
+	U32 matchIndex;
+
+	/* HC4 match finder */
+	LZ4E_HC_insert(ctx, src, insCur, ipIndex);
+	matchIndex = hashTable[LZ4E_HC_hash(ipSeq)];
+	LZ4E_cur_advance(src, &ipNextCur, MINMATCH);
+
+	while ((matchIndex >= lowLimit) && (nbAttempts)) {
+		const U32 candPos = matchIndex - startIndex;
+		LZ4E_cursor_t candCur;
+
+		nbAttempts--;
+
+		if (ipIndex - matchIndex < minOffset)
+			goto _next_chain;
+
+		candCur = LZ4E_getCursorNear(src, candPos, &ctx->segTable,
+			srcStart, ipCur, ipPos);
+
+		if (LZ4E_HC_mayBeLonger(ipCur, &candCur, (unsigned int)ml)
+			&& (LZ4E_read32(src, &candCur) == ipSeq)) {
+			int mlt;
+
+			LZ4E_cur_advance(src, &candCur, MINMATCH);
+			mlt = (int)LZ4E_count(src, ipNextCur, src, candCur,
+				matchlimit - ipPos - MINMATCH) + MINMATCH;
+
+			if (mlt > ml) {
+				ml = mlt;
+				*matchPos = candPos;
+			}
+		}
+
+_next_chain:
+		matchIndex -= chainTable[matchIndex & LZ4E_HC_MAXD_MASK];
+	}
+
+	return ml;
+}
+
+static FORCE_INLINE int LZ4E_HC_insertAndGetWiderMatch(
+	LZ4E_streamHC_t_internal *ctx,
+	const struct bio_vec *src,
+	const struct bvec_iter srcStart,
+	LZ4E_cursor_t *insCur,
+	const U32 startIndex,
+	const LZ4E_cursor_t *ipCur,
+	const U32 ipPos,
+	const U32 lowPos,
+	const U32 matchlimit,
+	int longest,
+	U32 *matchPos,
+	U32 *startPos,
+	const int maxNbAttempts)
+{
+	U16 * const chainTable = ctx->chainTable;
+	U32 * const hashTable = ctx->hashTable;
+	const U32 ipIndex = startIndex + ipPos;
+	const U32 lowLimit = (startIndex + MAX_DISTANCE > ipIndex)
+		? startIndex
+		: ipIndex - MAX_DISTANCE;
+	/* Matches closer than this are skipped, see LZ4E_DEC_SPEED_OFFSET */
+	const U32 minOffset = ctx->favorDecSpeed ? LZ4E_DEC_SPEED_OFFSET : 1;
+	const int delta = (int)(ipPos - lowPos);
+	const U32 ipSeq = LZ4E_read32(src, ipCur);
+	LZ4E_cursor_t lowCur;
+	LZ4E_cursor_t ipNextCur = *ipCur;
+	int nbAttempts = maxNbAttempts;
+	U32 matchIndex;
+
+	/* First Match */
+	LZ4E_HC_insert(ctx, src, insCur, ipIndex);
+	matchIndex = hashTable[LZ4E_HC_hash(ipSeq)];
+	lowCur = LZ4E_getCursorNear(src, lowPos, &ctx->segTable, srcStart,
+		ipCur, ipPos);
+	LZ4E_cur_advance(src, &ipNextCur, MINMATCH);
+
+	while ((matchIndex >= lowLimit) && (nbAttempts)) {
+		const U32 candPos = matchIndex - startIndex;
+		LZ4E_cursor_t candCur;
+
+		nbAttempts--;
+
+		if (ipIndex - matchIndex < minOffset)
+			goto _next_chain;
+
+		candCur = LZ4E_getCursorNear(src, candPos, &ctx->segTable,
+			srcStart, ipCur, ipPos);
+
+		/* Byte past the longest match, counted from 'lowPos' */
+		if (candPos >= (U32)delta) {
+			const LZ4E_cursor_t candLowCur = LZ4E_getCursorNear(src,
+				candPos - delta, &ctx->segTable, srcStart,
+				&candCur, candPos);
+
+			if (!LZ4E_HC_mayBeLonger(&lowCur, &candLowCur,
+					(unsigned int)longest))
+				goto _next_chain;
+		}
+
+		if (LZ4E_read32(src, &candCur) == ipSeq) {
+			LZ4E_cursor_t candNextCur = candCur;
+			LZ4E_cursor_t ipBackCur = *ipCur;
+			LZ4E_cursor_t candBackCur = candCur;
+			int mlt;
+			int back = 0;
+
+			LZ4E_cur_advance(src, &candNextCur, MINMATCH);
+			mlt = (int)LZ4E_count(src, ipNextCur, src, candNextCur,
+				matchlimit - ipPos - MINMATCH) + MINMATCH;
+
+			while (((int)ipPos + back > (int)lowPos)
+				&& ((int)candPos + back > 0)) {
+				LZ4E_cur_rollback1(src, &ipBackCur);
+				LZ4E_cur_rollback1(src, &candBackCur);
+
+				if (LZ4E_read8(src, &ipBackCur)
+						!= LZ4E_read8(src, &candBackCur))
+					break;
+
+				back--;
+			}
+
+			mlt -= back;
+
+			if (mlt > longest) {
+				longest = mlt;
+				*matchPos = candPos + back;
+				*startPos = ipPos + back;
+			}
+		}
+
+_next_chain:
+		matchIndex -= chainTable[matchIndex & LZ4E_HC_MAXD_MASK];
+	}
+
+	return longest;
+}
+
+/*
+ * Encode the sequence of literals from 'anchorPos' up to 'ipPos'
+ * followed by the match, then move both anchor and 'ipPos' past it.
+ * Returns 1 if the output is full.
+ */
+static FORCE_INLINE int LZ4E_HC_encodeSequence(
+	const struct bio_vec *src,
+	struct bio_vec *dst,
+	U32 *ipPos,
+	LZ4E_cursor_t *anchorCur,
+	U32 *anchorPos,
+	LZ4E_cursor_t *dstCur,
+	U32 *dstPos,
+	int matchLength,
+	const U32 matchPos,
+	const limitedOutput_directive limitedOutputBuffer,
+	const U32 maxOutputSize,
+	const U32 favorDecSpeed)
+{
+	const unsigned int litLength = *ipPos - *anchorPos;
+	unsigned int length;
+	LZ4E_cursor_t tokenCur;
+	BYTE token;
+
+	/*
+	 * Only matches fitting into the token are decoded by the shortcut.
+	 * With favorDecSpeed, a match a bit longer than that is cut, and
+	 * its rest is left to the following sequences.
+	 */
+	if ((favorDecSpeed) && (matchLength > OPTIMAL_ML)
+		&& (matchLength <= 2 * OPTIMAL_ML))
+		matchLength = OPTIMAL_ML;
+
+	/* Check output limit */
+	if ((limitedOutputBuffer)
+		&& ((*dstPos + 1 + litLength + (2 + 1 + LASTLITERALS)
+			+ (litLength / 255)) > maxOutputSize))
+		return 1;
+
+	/* Encode Literal length */
+	tokenCur = *dstCur;
+	LZ4E_advance1(dst, dstCur, dstPos);
+
+	if (litLength >= RUN_MASK) {
+		length = litLength - RUN_MASK;
+		token = (RUN_MASK << ML_BITS);
+
+		for (; length >= 255; length -= 255) {
+			LZ4E_write8(dst, 255, dstCur);
+			LZ4E_advance1(dst, dstCur, dstPos);
+		}
+		LZ4E_write8(dst, (BYTE)length, dstCur);
+		LZ4E_advance1(dst, dstCur, dstPos);
+	} else
+		token = (BYTE)(litLength << ML_BITS);
+
+	/* Copy Literals */
+	LZ4E_wildCopy(dst, src, *dstCur, *anchorCur, litLength);
+	LZ4E_advance(dst, dstCur, dstPos, litLength);
+
+	/* Encode Offset */
+	LZ4E_writeLE16(dst, (U16)(*ipPos - matchPos), dstCur);
+	LZ4E_advance(dst, dstCur, dstPos, 2);
+
+	/* Encode MatchLength */
+	length = (unsigned int)(matchLength - MINMATCH);
+
+	if ((limitedOutputBuffer)
+		&& (*dstPos + (1 + LASTLITERALS) + (length >> 8)
+			> maxOutputSize))
+		return 1;
+
+	if (length >= ML_MASK) {
+		token += ML_MASK;
+		length -= ML_MASK;
+
+		for (; length >= 255; length -= 255) {
+			LZ4E_write8(dst, 255, dstCur);
+			LZ4E_advance1(dst, dstCur, dstPos);
+		}
+		LZ4E_write8(dst, (BYTE)length, dstCur);
+		LZ4E_advance1(dst, dstCur, dstPos);
+	} else
+		token += (BYTE)length;
+
+	LZ4E_write8(dst, token, &tokenCur);
+
+	/* Prepare next loop */
+	*ipPos += matchLength;
+	LZ4E_cur_advance(src, anchorCur, *ipPos - *anchorPos);
+	*anchorPos = *ipPos;
+
+	return 0;
+}
+
+static int LZ4E_HC_compress_generic(
+	LZ4E_streamHC_t_internal * const ctx,
+	const struct bio_vec * const src,
+	struct bio_vec * const dst,
+	struct bvec_iter * const srcIter,
+	struct bvec_iter * const dstIter,
+	int compressionLevel,
+	const limitedOutput_directive limit)
+{
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int maxOutputSize = dstIter->bi_size;
+	const struct bvec_iter srcStart = *srcIter;
+	LZ4E_cursor_t anchorCur = LZ4E_cur_init(src, *srcIter);
+	LZ4E_cursor_t dstCur = LZ4E_cur_init(dst, *dstIter);
+	LZ4E_cursor_t insCur;
+	LZ4E_cursor_t nearCur;
+
+	const U32 mflimit = inputSize - MFLIMIT;
+	const U32 matchlimit = inputSize - LASTLITERALS;
+
+	U32 ip = 0;
+	U32 anchor = 0;
+	U32 dstPos = 0;
+	U32 nearPos = 0;
+
+	int maxNbAttempts;
+	int ml, ml2, ml3, ml0;
+	U32 ref = 0;
+	U32 start2 = 0;
+	U32 ref2 = 0;
+	U32 start3 = 0;
+	U32 ref3 = 0;
+	U32 start0;
+	U32 ref0;
+
+	/* Hash table entries below this index are left from previous calls */
+	const U32 startIndex = ctx->currentOffset;
+	const U32 favorDecSpeed = ctx->favorDecSpeed;
+
+	/* Init conditions */
+	if (inputSize > LZ4E_MAX_INPUT_SIZE) {
+		/* Unsupported inputSize, too large (or negative) */
+		return 0;
+	}
+
+	/* Keep chains of this call below the next start index */
+	ctx->currentOffset += inputSize;
+	ctx->nextToUpdate = startIndex;
+
+	if (inputSize < LZ4E_MIN_LENGTH) {
+		/* Input too small, no compression (all literals) */
+		goto _last_literals;
+	}
+
+	/* Fill positions of bvecs for translating match offsets */
+	if (!LZ4E_fillSegTable(&ctx->segTable, src, srcStart)) {
+		/* Too many bvecs */
+		return 0;
+	}
+
+	/* init */
+	if (compressionLevel > LZ4E_HC_MAX_CLEVEL)
+		compressionLevel = LZ4E_HC_MAX_CLEVEL;
+	if (compressionLevel < 1)
+		compressionLevel = LZ4E_HC_DEFAULT_CLEVEL;
+	if (compressionLevel < LZ4E_HC_MIN_CLEVEL)
+		compressionLevel = LZ4E_HC_MIN_CLEVEL;
+
+	maxNbAttempts = 1 << (compressionLevel - 1);
+
+	insCur = anchorCur;
+	nearCur = anchorCur;
+	ip++;
+
+	/* Main Loop */
+	while (ip < mflimit) {
+		nearCur = LZ4E_getCursorNear(src, ip, &ctx->segTable,
+			srcStart, &nearCur, nearPos);
+		nearPos = ip;
+
+		ml = LZ4E_HC_insertAndFindBestMatch(ctx, src, srcStart, &insCur,
+			startIndex, &nearCur, ip, matchlimit, &ref,
+			maxNbAttempts);
+
+		if (!ml) {
+			ip++;
+			continue;
+		}
+
+		/* saved, in case we would skip too much */
+		start0 = ip;
+		ref0 = ref;
+		ml0 = ml;
+
+_Search2:
+		if (ip + ml < mflimit) {
+			nearCur = LZ4E_getCursorNear(src, ip + ml - 2,
+				&ctx->segTable, srcStart, &nearCur, nearPos);
+			nearPos = ip + ml - 2;
+
+			ml2 = LZ4E_HC_insertAndGetWiderMatch(ctx, src, srcStart,
+				&insCur, startIndex, &nearCur, nearPos, ip,
+				matchlimit, ml, &ref2, &start2, maxNbAttempts);
+		} else
+			ml2 = ml;
+
+		if (ml2 == ml) {
+			/* No better match */
+			if (LZ4E_HC_encodeSequence(src, dst, &ip, &anchorCur,
+					&anchor, &dstCur, &dstPos, ml, ref,
+					limit, maxOutputSize, favorDecSpeed))
+				return 0;
+			continue;
+		}
+
+		if (start0 < ip) {
+			if (start2 < ip + ml0) {
+				/* empirical */
+				ip = start0;
+				ref = ref0;
+				ml = ml0;
+			}
+		}
+
+		/* Here, start0 == ip */
+		if ((start2 - ip) < 3) {
+			/* First Match too small : removed */
+			ml = ml2;
+			ip = start2;
+			ref = ref2;
+			goto _Search2;
+		}
+
+_Search3:
+		/*
+		 * Currently we have :
+		 * ml2 > ml1, and
+		 * ip1 + 3 <= ip2 (usually < ip1 + ml1)
+		 */
+		if ((start2 - ip) < OPTIMAL_ML) {
+			int correction;
+			int new_ml = ml;
+
+			if (new_ml > OPTIMAL_ML)
+				new_ml = OPTIMAL_ML;
+			if (ip + new_ml > start2 + ml2 - MINMATCH)
+				new_ml = (int)(start2 - ip) + ml2 - MINMATCH;
+
+			correction = new_ml - (int)(start2 - ip);
+
+			if (correction > 0) {
+				start2 += correction;
+				ref2 += correction;
+				ml2 -= correction;
+			}
+		}
+
+		/*
+		 * Now, we have start2 = ip + new_ml,
+		 * with new_ml = min(ml, OPTIMAL_ML = 18)
+		 */
+		if (start2 + ml2 < mflimit) {
+			nearCur = LZ4E_getCursorNear(src, start2 + ml2 - 3,
+				&ctx->segTable, srcStart, &nearCur, nearPos);
+			nearPos = start2 + ml2 - 3;
+
+			ml3 = LZ4E_HC_insertAndGetWiderMatch(ctx, src, srcStart,
+				&insCur, startIndex, &nearCur, nearPos, start2,
+				matchlimit, ml2, &ref3, &start3, maxNbAttempts);
+		} else
+			ml3 = ml2;
+
+		if (ml3 == ml2) {
+			/* No better match : 2 sequences to encode */
+			/* ip & ref are known; Now for ml */
+			if (start2 < ip + ml)
+				ml = (int)(start2 - ip);
+
+			/* Now, encode 2 sequences */
+			if (LZ4E_HC_encodeSequence(src, dst, &ip, &anchorCur,
+					&anchor, &dstCur, &dstPos, ml, ref,
+					limit, maxOutputSize, favorDecSpeed))
+				return 0;
+
+			ip = start2;
+
+			if (LZ4E_HC_encodeSequence(src, dst, &ip, &anchorCur,
+					&anchor, &dstCur, &dstPos, ml2, ref2,
+					limit, maxOutputSize, favorDecSpeed))
+				return 0;
+
+			continue;
+		}
+
+		if (start3 < ip + ml + 3) {
+			/* Not enough space for match 2 : remove it */
+			if (start3 >= (ip + ml)) {
+				/*
+				 * can write Seq1 immediately
+				 * ==> Seq2 is removed,
+				 * so Seq3 becomes Seq1
+				 */
+				if (start2 < ip + ml) {
+					int correction = (int)(ip + ml - start2);
+
+					start2 += correction;
+					ref2 += correction;
+					ml2 -= correction;
+
+					if (ml2 < MINMATCH) {
+						start2 = start3;
+						ref2 = ref3;
+						ml2 = ml3;
+					}
+				}
+
+				if (LZ4E_HC_encodeSequence(src, dst, &ip,
+						&anchorCur, &anchor, &dstCur,
+						&dstPos, ml, ref, limit,
+						maxOutputSize, favorDecSpeed))
+					return 0;
+
+				ip = start3;
+				ref = ref3;
+				ml = ml3;
+
+				start0 = start2;
+				ref0 = ref2;
+				ml0 = ml2;
+				goto _Search2;
+			}
+
+			start2 = start3;
+			ref2 = ref3;
+			ml2 = ml3;
+			goto _Search3;
+		}
+
+		/*
+		 * OK, now we have 3 ascending matches;
+		 * let's write at least the first one
+		 * ip & ref are known; Now for ml
+		 */
+		if (start2 < ip + ml) {
+			if ((start2 - ip) < (int)ML_MASK) {
+				int correction;
+
+				if (ml > OPTIMAL_ML)
+					ml = OPTIMAL_ML;
+				if (ip + ml > start2 + ml2 - MINMATCH)
+					ml = (int)(start2 - ip) + ml2 - MINMATCH;
+
+				correction = ml - (int)(start2 - ip);
+
+				if (correction > 0) {
+					start2 += correction;
+					ref2 += correction;
+					ml2 -= correction;
+				}
+			} else
+				ml = (int)(start2 - ip);
+		}
+
+		if (LZ4E_HC_encodeSequence(src, dst, &ip, &anchorCur, &anchor,
+				&dstCur, &dstPos, ml, ref, limit,
+				maxOutputSize, favorDecSpeed))
+			return 0;
+
+		ip = start2;
+		ref = ref2;
+		ml = ml2;
+
+		start2 = start3;
+		ref2 = ref3;
+		ml2 = ml3;
+
+		goto _Search3;
+	}
+
+_last_literals:
+	/* Encode Last Literals */
+	{
+		const size_t lastRun = (size_t)(inputSize - anchor);
+
+		if ((limit) &&
+			/* Check output buffer overflow */
+			(dstPos + lastRun + 1 +
+			((lastRun + 255 - RUN_MASK) / 255) > (U32)maxOutputSize))
+			return 0;
+
+		if (lastRun >= RUN_MASK) {
+			size_t accumulator = lastRun - RUN_MASK;
+
+			LZ4E_write8(dst, RUN_MASK << ML_BITS, &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
+
+			for (; accumulator >= 255; accumulator -= 255) {
+				LZ4E_write8(dst, 255, &dstCur);
+				LZ4E_advance1(dst, &dstCur, &dstPos);
+			}
+			LZ4E_write8(dst, (BYTE)accumulator, &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
+		} else {
+			LZ4E_write8(dst, (BYTE)(lastRun << ML_BITS), &dstCur);
+			LZ4E_advance1(dst, &dstCur, &dstPos);
+		}
+
+		LZ4E_memcpy(dst, src, dstCur, anchorCur, lastRun);
+		LZ4E_advance(dst, &dstCur, &dstPos, lastRun);
+		LZ4E_cur_advance(src, &anchorCur, lastRun);
+	}
+
+	/* Report positions right after the consumed and written data */
+	*srcIter = anchorCur.iter;
+	*dstIter = dstCur.iter;
+
+	/* End */
+	return (int)dstPos;
+}
+
+/*
+ * Chains left from previous calls are told apart by their indexes, so
+ * the tables are only cleared when the indexes approach the limit.
+ */
+static void LZ4E_HC_prepareTables(LZ4E_streamHC_t_internal * const ctx)
+{
+	if (ctx->currentOffset > 1 * GB) {
+		const U32 favorDecSpeed = ctx->favorDecSpeed;
+
+		LZ4E_resetStreamHC((LZ4E_streamHC_t *)ctx);
+		ctx->favorDecSpeed = favorDecSpeed;
+	}
+
+	/* Keep entries of the previous call out of MAX_DISTANCE */
+	ctx->currentOffset += 64 * KB;
+}
+
+int LZ4E_compress_HC(const struct bio_vec *src, struct bio_vec *dst,
+	struct bvec_iter *srcIter, struct bvec_iter *dstIter,
+	int compressionLevel, void *wrkmem)
+{
+	LZ4E_streamHC_t_internal *ctx =
+		&((LZ4E_streamHC_t *)wrkmem)->internal_donotuse;
+	const unsigned int inputSize = srcIter->bi_size;
+	const unsigned int maxOutputSize = dstIter->bi_size;
+
+	LZ4_STATIC_ASSERT(sizeof(LZ4E_streamHC_t_internal)
+		<= LZ4E_STREAMHCSIZE);
+
+	LZ4E_HC_prepareTables(ctx);
+
+	if (maxOutputSize >= LZ4E_COMPRESSBOUND(inputSize)) {
+		return LZ4E_HC_compress_generic(ctx, src, dst, srcIter, dstIter,
+			compressionLevel, noLimit);
+	} else {
+		return LZ4E_HC_compress_generic(ctx, src, dst, srcIter, dstIter,
+			compressionLevel, limitedOutput);
+	}
+}
+EXPORT_SYMBOL(LZ4E_compress_HC);
+
+void LZ4E_resetStreamHC(LZ4E_streamHC_t *stream)
+{
+	memset(stream, 0, sizeof(*stream));
+}
+EXPORT_SYMBOL(LZ4E_resetStreamHC);
+
+void LZ4E_favorDecompressionSpeedHC(LZ4E_streamHC_t *stream, int favor)
+{
+	stream->internal_donotuse.favorDecSpeed = (favor != 0);
+}
+EXPORT_SYMBOL(LZ4E_favorDecompressionSpeedHC);
+
+MODULE_AUTHOR("Alexander Bugaev");
+MODULE_DESCRIPTION("LZ4 HC compression for scatter-gather buffers");
+MODULE_LICENSE("GPL");
@@ -20,11 +20,15 @@ struct lz4e_buffer {
 	int buf_size;
 } LZ4E_ALIGN_32;
 
+struct lz4e_dev;
+
 // Struct representing data to be compressed
 struct lz4e_chunk {
 	struct lz4e_buffer src_buf;
 	struct lz4e_buffer dst_buf;
-	void *wrkmem;
+	int blocks; // number of independent blocks in dst, 0 for a single one
+	bool raw; // dst is empty, since src turned out incompressible
+	bool same_filled; // src repeats a single word and is stored as is
 } LZ4E_ALIGN_128;
 
 // Copy data from the given bio
@@ -34,13 +38,29 @@ void lz4e_buf_copy_from_bio(struct lz4e_buffer *dst, struct bio *src);
 struct lz4e_chunk *lz4e_chunk_alloc(int src_size);
 
 // Compress data from source buffer into destination buffer
-int lz4e_chunk_compress(struct lz4e_chunk *chunk);
+int lz4e_chunk_compress(struct lz4e_chunk *chunk, void *wrkmem);
 
 // Decompress data from destination buffer into source buffer
 int lz4e_chunk_decompress(struct lz4e_chunk *chunk);
 
-// Compress data from src bio into dst bio using the extended algorithm
-int lz4e_chunk_compress_ext(struct lz4e_chunk *chunk);
+// Compress data from src bio into dst bio using the extended algorithm,
+// giving up if no match is found within the first probe_size bytes.
+// With dec_speed set, matches slow to decompress are avoided. The data is
+// expected to be checked for being same-filled beforehand
+int lz4e_chunk_compress_ext(struct lz4e_chunk *chunk, void *wrkmem,
+			    int acceleration, int probe_size, int dec_speed);
+
+// Compress data from src bio into dst bio using the extended HC algorithm
+int lz4e_chunk_compress_hc(struct lz4e_chunk *chunk, void *wrkmem, int level,
+			   int dec_speed);
+
+// Compress data from src bio into dst bio as independent blocks, which are
+// spread over CPUs through the workqueue of the device. The whole data is
+// stored as is if no match is found within its first probe_size bytes.
+// The data is expected to be checked for being same-filled beforehand
+int lz4e_chunk_compress_par(struct lz4e_chunk *chunk, struct lz4e_dev *lzdev,
+			    int acceleration, int hc_level, int probe_size,
+			    int dec_speed);
 
 // Free chunk for compression
 void lz4e_chunk_free(struct lz4e_chunk *chunk);
@@ -10,17 +10,33 @@
 
 #include <linux/blk_types.h>
 #include <linux/blkdev.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "lz4e_static.h"
 #include "lz4e_stats.h"
 #include "lz4e_under_dev.h"
 
+// Working memory of a CPU. It is taken under a mutex rather than with
+// preemption disabled, so that long compressions stay preemptible
+struct lz4e_wrkmem {
+	struct mutex lock;
+	void *fast;
+	void *hc;
+};
+
 // Struct representing a device to be managed by the driver
 struct lz4e_dev {
 	struct gendisk *disk;
 	struct lz4e_under_dev *under_dev;
 	struct lz4e_stats *read_stats;
 	struct lz4e_stats *write_stats;
+	struct lz4e_wrkmem *wrkmem;
+	struct workqueue_struct *comp_wq;
+	int acceleration;
+	int hc_level;
+	int probe_size;
+	int dec_speed;
 } LZ4E_ALIGN_32;
 
 // Allocate block device context
@@ -33,6 +49,12 @@ int lz4e_dev_init(struct lz4e_dev *lzdev, const char *dev_path, int major,
 // Free block device context
 void lz4e_dev_free(struct lz4e_dev *lzdev);
 
+// Take working memory of the current CPU, which may sleep
+struct lz4e_wrkmem *lz4e_wrkmem_get(struct lz4e_dev *lzdev);
+
+// Release working memory taken with lz4e_wrkmem_get()
+void lz4e_wrkmem_put(struct lz4e_wrkmem *wrkmem);
+
 // Submit bio request to device
 void lz4e_dev_submit_bio(struct bio *original_bio);
 
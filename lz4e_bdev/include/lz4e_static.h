@@ -19,6 +19,9 @@
 // Bio set pool size to use
 #define LZ4E_BIOSET_SIZE 1024
 
+// Minimal size of write bio to be compressed on multiple CPUs
+#define LZ4E_PAR_MIN_SIZE (256 * 1024)
+
 // Struct memory alignment attributes
 #define LZ4E_ALIGN_16 __attribute__((packed, aligned(16)))
 #define LZ4E_ALIGN_32 __attribute__((packed, aligned(32)))
@@ -5,17 +5,44 @@
  * This file is released under the GPL.
  */
 
+#include <linux/atomic.h>
 #include <linux/bio.h>
 #include <linux/blk_types.h>
 #include <linux/bvec.h>
+#include <linux/completion.h>
 #include <linux/lz4.h>
+#include <linux/minmax.h>
 #include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/unaligned.h>
+#include <linux/workqueue.h>
 
 #include "include/lz4e_chunk.h"
 
 #include "include/lz4e.h"
+#include "include/lz4e_dev.h"
 #include "include/lz4e_static.h"
 
+// Struct tracking blocks of a chunk compressed in parallel
+struct lz4e_par_ctx {
+	struct lz4e_chunk *chunk;
+	struct lz4e_dev *lzdev;
+	int acceleration;
+	int hc_level;
+	int dec_speed;
+	atomic_t pending;
+	struct completion done;
+};
+
+// Struct representing a block of a chunk to be compressed by a worker
+struct lz4e_block_work {
+	struct work_struct work;
+	struct lz4e_par_ctx *ctx;
+	struct bvec_iter src_iter;
+	struct bvec_iter dst_iter;
+	int ret;
+};
+
 void lz4e_buf_copy_from_bio(struct lz4e_buffer *dst, struct bio *src)
 {
 	char *ptr = dst->data;
@@ -39,7 +66,6 @@ void lz4e_chunk_free(struct lz4e_chunk *chunk)
 
 	kfree(chunk->src_buf.data);
 	kfree(chunk->dst_buf.data);
-	kfree(chunk->wrkmem);
 
 	kfree(chunk);
 
@@ -55,10 +81,10 @@ static inline void lz4e_buffer_init(struct lz4e_buffer *buf, char *data,
 
 struct lz4e_chunk *lz4e_chunk_alloc(int src_size)
 {
-	int dst_size = LZ4E_COMPRESSBOUND(src_size);
+	// Enough for both a single block and independent ones
+	int dst_size = LZ4E_BLOCKS_BOUND(src_size);
 	char *src_data;
 	char *dst_data;
-	void *wrkmem;
 	struct lz4e_chunk *chunk;
 
 	chunk = kzalloc(sizeof(*chunk), GFP_NOIO);
@@ -81,13 +107,6 @@ struct lz4e_chunk *lz4e_chunk_alloc(int src_size)
 		goto free_chunk;
 	}
 
-	wrkmem = kzalloc(LZ4E_MEM_COMPRESS, GFP_NOIO);
-	chunk->wrkmem = wrkmem;
-	if (!wrkmem) {
-		LZ4E_PR_ERR("failed to allocate working memory");
-		goto free_chunk;
-	}
-
 	LZ4E_PR_DEBUG("allocated chunk");
 	return chunk;
 
@@ -96,11 +115,10 @@ free_chunk:
 	return NULL;
 }
 
-int lz4e_chunk_compress(struct lz4e_chunk *chunk)
+int lz4e_chunk_compress(struct lz4e_chunk *chunk, void *wrkmem)
 {
 	struct lz4e_buffer src_buf = chunk->src_buf;
 	struct lz4e_buffer dst_buf = chunk->dst_buf;
-	void *wrkmem = chunk->wrkmem;
 	int ret;
 
 	ret = LZ4_compress_default(src_buf.data, dst_buf.data,
@@ -116,12 +134,49 @@ int lz4e_chunk_compress(struct lz4e_chunk *chunk)
 	return 0;
 }
 
+static int lz4e_chunk_decompress_blocks(struct lz4e_chunk *chunk)
+{
+	struct lz4e_buffer src_buf = chunk->src_buf;
+	struct lz4e_buffer dst_buf = chunk->dst_buf;
+	int off = LZ4E_BLOCKS_HEADER_SIZE(chunk->blocks);
+	int block_size;
+	int comp_size;
+	int ret;
+	int i;
+
+	for (i = 0; i < chunk->blocks; i++) {
+		comp_size = (int)get_unaligned_le32(dst_buf.data + 4 + 4 * i);
+		block_size = min(src_buf.buf_size - i * LZ4E_BLOCK_SIZE,
+				 LZ4E_BLOCK_SIZE);
+
+		ret = LZ4_decompress_safe(dst_buf.data + off,
+					  src_buf.data + i * LZ4E_BLOCK_SIZE,
+					  comp_size, block_size);
+		if (ret < 0) {
+			LZ4E_PR_ERR("failed to decompress block %d", i);
+			return -EIO;
+		}
+
+		BUG_ON(ret != block_size);
+		off += comp_size;
+	}
+
+	chunk->src_buf.data_size = src_buf.buf_size;
+
+	LZ4E_PR_INFO("decompressed data into src buffer: %d bytes in %d blocks",
+		     src_buf.buf_size, chunk->blocks);
+	return 0;
+}
+
 int lz4e_chunk_decompress(struct lz4e_chunk *chunk)
 {
 	struct lz4e_buffer src_buf = chunk->src_buf;
 	struct lz4e_buffer dst_buf = chunk->dst_buf;
 	int ret;
 
+	if (chunk->blocks)
+		return lz4e_chunk_decompress_blocks(chunk);
+
 	ret = LZ4_decompress_safe(dst_buf.data, src_buf.data, dst_buf.data_size,
 				  src_buf.buf_size);
 	if (ret < 0) {
@@ -136,17 +191,27 @@ int lz4e_chunk_decompress(struct lz4e_chunk *chunk)
 	return 0;
 }
 
-int lz4e_chunk_compress_ext(struct lz4e_chunk *chunk)
+int lz4e_chunk_compress_ext(struct lz4e_chunk *chunk, void *wrkmem,
+			    int acceleration, int probe_size, int dec_speed)
 {
 	struct bio *src_bio = chunk->src_buf.bio;
 	struct bio *dst_bio = chunk->dst_buf.bio;
 	struct bvec_iter src_iter = src_bio->bi_iter;
 	struct bvec_iter dst_iter = dst_bio->bi_iter;
-	void *wrkmem = chunk->wrkmem;
 	int ret;
 
-	ret = LZ4E_compress_default(src_bio->bi_io_vec, dst_bio->bi_io_vec,
-				    &src_iter, &dst_iter, wrkmem);
+	LZ4E_favorDecompressionSpeed(wrkmem, dec_speed);
+	LZ4E_skipSameFilled(wrkmem, 1);
+	ret = LZ4E_compress_probe(src_bio->bi_io_vec, dst_bio->bi_io_vec,
+				  &src_iter, &dst_iter, acceleration,
+				  (unsigned int)probe_size, wrkmem);
+	if (ret == LZ4E_INCOMPRESSIBLE) {
+		chunk->dst_buf.data_size = 0;
+		chunk->raw = true;
+
+		LZ4E_PR_INFO("data is incompressible, storing it as is");
+		return 0;
+	}
 	if (!ret) {
 		LZ4E_PR_ERR("failed to compress data");
 		return -EIO;
@@ -157,3 +222,182 @@ int lz4e_chunk_compress_ext(struct lz4e_chunk *chunk)
 	LZ4E_PR_INFO("compressed data into dst buffer: %d bytes", ret);
 	return 0;
 }
+
+int lz4e_chunk_compress_hc(struct lz4e_chunk *chunk, void *wrkmem, int level,
+			   int dec_speed)
+{
+	struct bio *src_bio = chunk->src_buf.bio;
+	struct bio *dst_bio = chunk->dst_buf.bio;
+	struct bvec_iter src_iter = src_bio->bi_iter;
+	struct bvec_iter dst_iter = dst_bio->bi_iter;
+	int ret;
+
+	LZ4E_favorDecompressionSpeedHC(wrkmem, dec_speed);
+	ret = LZ4E_compress_HC(src_bio->bi_io_vec, dst_bio->bi_io_vec,
+			       &src_iter, &dst_iter, level, wrkmem);
+	if (!ret) {
+		LZ4E_PR_ERR("failed to compress data");
+		return -EIO;
+	}
+
+	chunk->dst_buf.data_size = ret;
+
+	LZ4E_PR_INFO("compressed data into dst buffer: %d bytes", ret);
+	return 0;
+}
+
+static void lz4e_block_compress(struct work_struct *work)
+{
+	struct lz4e_block_work *bw =
+		container_of(work, struct lz4e_block_work, work);
+	struct lz4e_par_ctx *ctx = bw->ctx;
+	struct bio *src_bio = ctx->chunk->src_buf.bio;
+	struct bio *dst_bio = ctx->chunk->dst_buf.bio;
+	struct lz4e_wrkmem *wrkmem = lz4e_wrkmem_get(ctx->lzdev);
+
+	if (ctx->hc_level) {
+		LZ4E_favorDecompressionSpeedHC(wrkmem->hc, ctx->dec_speed);
+		bw->ret = LZ4E_compress_HC(src_bio->bi_io_vec,
+					   dst_bio->bi_io_vec, &bw->src_iter,
+					   &bw->dst_iter, ctx->hc_level,
+					   wrkmem->hc);
+	} else {
+		LZ4E_favorDecompressionSpeed(wrkmem->fast, ctx->dec_speed);
+		LZ4E_skipSameFilled(wrkmem->fast, 1);
+		bw->ret = LZ4E_compress_fast(src_bio->bi_io_vec,
+					     dst_bio->bi_io_vec, &bw->src_iter,
+					     &bw->dst_iter, ctx->acceleration,
+					     wrkmem->fast);
+	}
+
+	lz4e_wrkmem_put(wrkmem);
+
+	if (atomic_dec_and_test(&ctx->pending))
+		complete(&ctx->done);
+}
+
+// Check whether the first probe_size bytes of src bio hold any match. Only
+// they are compressed, into the start of dst bio, which is overwritten later
+static bool lz4e_chunk_probe(struct lz4e_chunk *chunk, struct lz4e_dev *lzdev,
+			     int acceleration, int probe_size)
+{
+	struct bio *src_bio = chunk->src_buf.bio;
+	struct bio *dst_bio = chunk->dst_buf.bio;
+	struct bvec_iter src_iter = src_bio->bi_iter;
+	struct bvec_iter dst_iter = dst_bio->bi_iter;
+	struct lz4e_wrkmem *wrkmem;
+	int ret;
+
+	src_iter.bi_size = min_t(unsigned int, src_iter.bi_size,
+				 (unsigned int)probe_size);
+
+	wrkmem = lz4e_wrkmem_get(lzdev);
+	LZ4E_skipSameFilled(wrkmem->fast, 1);
+	ret = LZ4E_compress_probe(src_bio->bi_io_vec, dst_bio->bi_io_vec,
+				  &src_iter, &dst_iter, acceleration,
+				  (unsigned int)probe_size, wrkmem->fast);
+	lz4e_wrkmem_put(wrkmem);
+
+	return ret == LZ4E_INCOMPRESSIBLE;
+}
+
+int lz4e_chunk_compress_par(struct lz4e_chunk *chunk, struct lz4e_dev *lzdev,
+			    int acceleration, int hc_level, int probe_size,
+			    int dec_speed)
+{
+	struct bio *src_bio = chunk->src_buf.bio;
+	struct bio *dst_bio = chunk->dst_buf.bio;
+	unsigned int src_size = src_bio->bi_iter.bi_size;
+	int blocks = (int)LZ4E_BLOCKS_COUNT(src_size);
+	int header_size = LZ4E_BLOCKS_HEADER_SIZE(blocks);
+	int slot_size = LZ4E_COMPRESSBOUND(LZ4E_BLOCK_SIZE);
+	struct bvec_iter src_iter = src_bio->bi_iter;
+	struct bvec_iter dst_iter = dst_bio->bi_iter;
+	char *data = chunk->dst_buf.data;
+	struct lz4e_block_work *works;
+	struct lz4e_par_ctx ctx = {
+		.chunk = chunk,
+		.lzdev = lzdev,
+		.acceleration = acceleration,
+		.hc_level = hc_level,
+		.dec_speed = dec_speed,
+	};
+	int off;
+	int ret = 0;
+	int i;
+
+	// The bio is probed once as a whole, with either algorithm
+	if (probe_size && lz4e_chunk_probe(chunk, lzdev, acceleration,
+					   probe_size)) {
+		chunk->dst_buf.data_size = 0;
+		chunk->raw = true;
+
+		LZ4E_PR_INFO("data is incompressible, storing %u bytes as is",
+			     src_size);
+		return 0;
+	}
+
+	works = kcalloc((size_t)blocks, sizeof(*works), GFP_NOIO);
+	if (!works) {
+		LZ4E_PR_ERR("failed to allocate block works");
+		return -ENOMEM;
+	}
+
+	atomic_set(&ctx.pending, blocks);
+	init_completion(&ctx.done);
+
+	// Every block is compressed into its own slot of the maximal size
+	bvec_iter_advance(dst_bio->bi_io_vec, &dst_iter, header_size);
+
+	for (i = 0; i < blocks; i++) {
+		struct lz4e_block_work *bw = &works[i];
+		unsigned int block_size = min_t(unsigned int, src_iter.bi_size,
+						LZ4E_BLOCK_SIZE);
+
+		bw->ctx = &ctx;
+		bw->src_iter = src_iter;
+		bw->src_iter.bi_size = block_size;
+		bw->dst_iter = dst_iter;
+		bw->dst_iter.bi_size = LZ4E_COMPRESSBOUND(block_size);
+		INIT_WORK(&bw->work, lz4e_block_compress);
+
+		bvec_iter_advance(src_bio->bi_io_vec, &src_iter, block_size);
+		if (i + 1 < blocks)
+			bvec_iter_advance(dst_bio->bi_io_vec, &dst_iter,
+					  slot_size);
+	}
+
+	// The submitting CPU takes the first block itself
+	for (i = 1; i < blocks; i++)
+		queue_work(lzdev->comp_wq, &works[i].work);
+
+	lz4e_block_compress(&works[0].work);
+	wait_for_completion(&ctx.done);
+
+	// Stitch blocks in order right after the index of their sizes
+	put_unaligned_le32(src_size, data);
+	off = header_size;
+
+	for (i = 0; i < blocks; i++) {
+		if (!works[i].ret) {
+			LZ4E_PR_ERR("failed to compress block %d", i);
+			ret = -EIO;
+			goto free_works;
+		}
+
+		memmove(data + off, data + header_size + i * slot_size,
+			(size_t)works[i].ret);
+		put_unaligned_le32((u32)works[i].ret, data + 4 + 4 * i);
+		off += works[i].ret;
+	}
+
+	chunk->dst_buf.data_size = off;
+	chunk->blocks = blocks;
+
+	LZ4E_PR_INFO("compressed data into dst buffer: %d bytes in %d blocks",
+		     off, blocks);
+
+free_works:
+	kfree(works);
+	return ret;
+}
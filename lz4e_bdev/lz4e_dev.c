@@ -8,13 +8,19 @@
 #include <linux/bio.h>
 #include <linux/blk_types.h>
 #include <linux/blkdev.h>
+#include <linux/cpumask.h>
 #include <linux/gfp_types.h>
 #include <linux/nodemask_types.h>
+#include <linux/mutex.h>
+#include <linux/smp.h>
 #include <linux/slab.h>
 #include <linux/stddef.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "include/lz4e_dev.h"
 
+#include "include/lz4e.h"
 #include "include/lz4e_req.h"
 #include "include/lz4e_static.h"
 #include "include/lz4e_stats.h"
@@ -83,6 +89,97 @@ static int lz4e_gendisk_add(struct gendisk *disk, struct lz4e_dev *lzdev,
 	return 0;
 }
 
+static void lz4e_wrkmem_free(struct lz4e_wrkmem *wrkmem)
+{
+	int cpu;
+
+	if (!wrkmem)
+		return;
+
+	for_each_possible_cpu (cpu) {
+		vfree(wrkmem[cpu].fast);
+		vfree(wrkmem[cpu].hc);
+	}
+
+	kfree(wrkmem);
+
+	LZ4E_PR_DEBUG("released working memory");
+}
+
+static struct lz4e_wrkmem *lz4e_wrkmem_alloc(void)
+{
+	struct lz4e_wrkmem *wrkmem;
+	int cpu;
+
+	wrkmem = kcalloc(nr_cpu_ids, sizeof(*wrkmem), GFP_KERNEL);
+	if (!wrkmem) {
+		LZ4E_PR_ERR("failed to allocate working memory table");
+		return NULL;
+	}
+
+	// Zeroed on allocation, so it is ready for compression
+	for_each_possible_cpu (cpu) {
+		mutex_init(&wrkmem[cpu].lock);
+
+		wrkmem[cpu].fast = vzalloc(LZ4E_MEM_COMPRESS);
+		wrkmem[cpu].hc = vzalloc(LZ4E_HC_MEM_COMPRESS);
+		if (!wrkmem[cpu].fast || !wrkmem[cpu].hc) {
+			LZ4E_PR_ERR("failed to allocate working memory");
+			goto free_wrkmem;
+		}
+	}
+
+	LZ4E_PR_DEBUG("allocated working memory");
+	return wrkmem;
+
+free_wrkmem:
+	lz4e_wrkmem_free(wrkmem);
+	return NULL;
+}
+
+struct lz4e_wrkmem *lz4e_wrkmem_get(struct lz4e_dev *lzdev)
+{
+	// The CPU only picks the memory likely to be warm in its cache.
+	// The task may be preempted or migrated afterwards, while the mutex
+	// keeps the memory to itself
+	struct lz4e_wrkmem *wrkmem = &lzdev->wrkmem[raw_smp_processor_id()];
+
+	mutex_lock(&wrkmem->lock);
+	return wrkmem;
+}
+
+void lz4e_wrkmem_put(struct lz4e_wrkmem *wrkmem)
+{
+	mutex_unlock(&wrkmem->lock);
+}
+
+static void lz4e_comp_wq_free(struct workqueue_struct *comp_wq)
+{
+	if (!comp_wq)
+		return;
+
+	destroy_workqueue(comp_wq);
+
+	LZ4E_PR_DEBUG("released compression workqueue");
+}
+
+static struct workqueue_struct *lz4e_comp_wq_alloc(void)
+{
+	struct workqueue_struct *comp_wq;
+
+	// Unbound, so that blocks of a bio are run on different CPUs,
+	// and able to make progress under memory pressure as writeback does
+	comp_wq = alloc_workqueue(LZ4E_MODULE_NAME "_comp",
+				  WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!comp_wq) {
+		LZ4E_PR_ERR("failed to allocate compression workqueue");
+		return NULL;
+	}
+
+	LZ4E_PR_DEBUG("allocated compression workqueue");
+	return comp_wq;
+}
+
 void lz4e_dev_free(struct lz4e_dev *lzdev)
 {
 	if (!lzdev)
@@ -92,6 +189,8 @@ void lz4e_dev_free(struct lz4e_dev *lzdev)
 	lz4e_under_dev_free(lzdev->under_dev);
 	lz4e_stats_free(lzdev->read_stats);
 	lz4e_stats_free(lzdev->write_stats);
+	lz4e_wrkmem_free(lzdev->wrkmem);
+	lz4e_comp_wq_free(lzdev->comp_wq);
 
 	kfree(lzdev);
 
@@ -104,6 +203,8 @@ struct lz4e_dev *lz4e_dev_alloc(void)
 	struct lz4e_under_dev *under_dev;
 	struct lz4e_stats *read_stats;
 	struct lz4e_stats *write_stats;
+	struct lz4e_wrkmem *wrkmem;
+	struct workqueue_struct *comp_wq;
 	struct lz4e_dev *lzdev;
 
 	lzdev = kzalloc(sizeof(*lzdev), GFP_KERNEL);
@@ -140,6 +241,22 @@ struct lz4e_dev *lz4e_dev_alloc(void)
 		goto free_device;
 	}
 
+	wrkmem = lz4e_wrkmem_alloc();
+	lzdev->wrkmem = wrkmem;
+	if (!wrkmem) {
+		LZ4E_PR_ERR("failed to allocate working memory");
+		goto free_device;
+	}
+
+	comp_wq = lz4e_comp_wq_alloc();
+	lzdev->comp_wq = comp_wq;
+	if (!comp_wq) {
+		LZ4E_PR_ERR("failed to allocate compression workqueue");
+		goto free_device;
+	}
+
+	lzdev->acceleration = LZ4E_ACCELERATION_DEFAULT;
+
 	LZ4E_PR_DEBUG("allocated block device context");
 	return lzdev;
 
@@ -6,7 +6,9 @@
  */
 
 #include <linux/blkdev.h>
+#include <linux/compiler.h>
 #include <linux/init.h>
+#include <linux/kstrtox.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/stat.h>
@@ -15,6 +17,7 @@
 
 #include "include/lz4e_module.h"
 
+#include "include/lz4e.h"
 #include "include/lz4e_dev.h"
 #include "include/lz4e_static.h"
 #include "include/lz4e_stats.h"
@@ -145,6 +148,193 @@ static int lz4e_get_stats(char *buf, const struct kernel_param *kpar)
 	return ret;
 }
 
+static int lz4e_set_acceleration(const char *arg,
+				 const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int acceleration;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device to configure");
+		return -ENODEV;
+	}
+
+	ret = kstrtoint(arg, 0, &acceleration);
+	if (ret) {
+		LZ4E_PR_ERR("failed to parse acceleration");
+		return ret;
+	}
+
+	if (acceleration < 1 || acceleration > LZ4E_ACCELERATION_MAX) {
+		LZ4E_PR_ERR("acceleration must be in range [1, %d]",
+			    LZ4E_ACCELERATION_MAX);
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(lzdev->acceleration, acceleration);
+
+	LZ4E_PR_INFO("acceleration set to %d", acceleration);
+	return 0;
+}
+
+static int lz4e_get_acceleration(char *buf, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device found");
+		return -ENODEV;
+	}
+
+	ret = sysfs_emit(buf, "%d\n", READ_ONCE(lzdev->acceleration));
+	if (ret < 0)
+		LZ4E_PR_ERR("failed to write acceleration");
+
+	return ret;
+}
+
+static int lz4e_set_hc_level(const char *arg, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int hc_level;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device to configure");
+		return -ENODEV;
+	}
+
+	ret = kstrtoint(arg, 0, &hc_level);
+	if (ret) {
+		LZ4E_PR_ERR("failed to parse HC level");
+		return ret;
+	}
+
+	// Zero switches back to the fast compression
+	if (hc_level &&
+	    (hc_level < LZ4E_HC_MIN_CLEVEL || hc_level > LZ4E_HC_MAX_CLEVEL)) {
+		LZ4E_PR_ERR("HC level must be 0 or in range [%d, %d]",
+			    LZ4E_HC_MIN_CLEVEL, LZ4E_HC_MAX_CLEVEL);
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(lzdev->hc_level, hc_level);
+
+	LZ4E_PR_INFO("HC level set to %d", hc_level);
+	return 0;
+}
+
+static int lz4e_get_hc_level(char *buf, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device found");
+		return -ENODEV;
+	}
+
+	ret = sysfs_emit(buf, "%d\n", READ_ONCE(lzdev->hc_level));
+	if (ret < 0)
+		LZ4E_PR_ERR("failed to write HC level");
+
+	return ret;
+}
+
+static int lz4e_set_probe_size(const char *arg,
+			       const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int probe_size;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device to configure");
+		return -ENODEV;
+	}
+
+	ret = kstrtoint(arg, 0, &probe_size);
+	if (ret) {
+		LZ4E_PR_ERR("failed to parse probe size");
+		return ret;
+	}
+
+	// Zero disables the probe, so every request is compressed in full
+	if (probe_size < 0) {
+		LZ4E_PR_ERR("probe size must not be negative");
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(lzdev->probe_size, probe_size);
+
+	LZ4E_PR_INFO("probe size set to %d", probe_size);
+	return 0;
+}
+
+static int lz4e_get_probe_size(char *buf, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device found");
+		return -ENODEV;
+	}
+
+	ret = sysfs_emit(buf, "%d\n", READ_ONCE(lzdev->probe_size));
+	if (ret < 0)
+		LZ4E_PR_ERR("failed to write probe size");
+
+	return ret;
+}
+
+static int lz4e_set_dec_speed(const char *arg, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int dec_speed;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device to configure");
+		return -ENODEV;
+	}
+
+	ret = kstrtoint(arg, 0, &dec_speed);
+	if (ret) {
+		LZ4E_PR_ERR("failed to parse decompression speed mode");
+		return ret;
+	}
+
+	if (dec_speed != 0 && dec_speed != 1) {
+		LZ4E_PR_ERR("decompression speed mode must be 0 or 1");
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(lzdev->dec_speed, dec_speed);
+
+	LZ4E_PR_INFO("decompression speed mode set to %d", dec_speed);
+	return 0;
+}
+
+static int lz4e_get_dec_speed(char *buf, const struct kernel_param *kpar)
+{
+	struct lz4e_dev *lzdev = lzmod.lzdev;
+	int ret;
+
+	if (!lzdev) {
+		LZ4E_PR_ERR("no device found");
+		return -ENODEV;
+	}
+
+	ret = sysfs_emit(buf, "%d\n", READ_ONCE(lzdev->dec_speed));
+	if (ret < 0)
+		LZ4E_PR_ERR("failed to write decompression speed mode");
+
+	return ret;
+}
+
 // Callbacks can have unused parameters
 // NOLINTEND(misc-unused-parameters)
 
@@ -192,6 +382,26 @@ static const struct kernel_param_ops lz4e_stats_ops = {
 	.get = lz4e_get_stats,
 };
 
+static const struct kernel_param_ops lz4e_acceleration_ops = {
+	.set = lz4e_set_acceleration,
+	.get = lz4e_get_acceleration,
+};
+
+static const struct kernel_param_ops lz4e_hc_level_ops = {
+	.set = lz4e_set_hc_level,
+	.get = lz4e_get_hc_level,
+};
+
+static const struct kernel_param_ops lz4e_probe_size_ops = {
+	.set = lz4e_set_probe_size,
+	.get = lz4e_get_probe_size,
+};
+
+static const struct kernel_param_ops lz4e_dec_speed_ops = {
+	.set = lz4e_set_dec_speed,
+	.get = lz4e_get_dec_speed,
+};
+
 module_param_cb(mapper, &lz4e_map_ops, NULL, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(mapper, "Map to existing block device");
 
@@ -201,6 +411,19 @@ MODULE_PARM_DESC(unmapper, "Unmap from existing block device");
 module_param_cb(stats, &lz4e_stats_ops, NULL, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(stats, "Block device request statistics");
 
+module_param_cb(acceleration, &lz4e_acceleration_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(acceleration, "Compression acceleration factor of the device");
+
+module_param_cb(hc_level, &lz4e_hc_level_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hc_level, "HC compression level of the device, 0 to disable");
+
+module_param_cb(probe_size, &lz4e_probe_size_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(probe_size,
+		 "Bytes searched for a match before storing data as is, 0 to disable");
+
+module_param_cb(dec_speed, &lz4e_dec_speed_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dec_speed, "Favor decompression speed over ratio, 0 or 1");
+
 module_init(lz4e_module_init);
 module_exit(lz4e_module_exit);
 
@@ -8,10 +8,12 @@
 #include <linux/bio.h>
 #include <linux/blk_types.h>
 #include <linux/blkdev.h>
+#include <linux/cpumask.h>
 #include <linux/gfp_types.h>
 #include <linux/math.h>
 #include <linux/minmax.h>
 #include <linux/mm.h>
+#include <linux/smp.h>
 #include <linux/slab.h>
 #include <linux/stddef.h>
 
@@ -84,7 +86,7 @@ static inline unsigned short lz4e_bio_bytes_to_pages(size_t bytes)
 static struct bio *lz4e_alloc_new_bio(struct bio *original_bio,
 				      struct lz4e_under_dev *under_dev)
 {
-	size_t bsize = LZ4E_COMPRESSBOUND(original_bio->bi_iter.bi_size);
+	size_t bsize = LZ4E_BLOCKS_BOUND(original_bio->bi_iter.bi_size);
 	struct block_device *bdev = under_dev->bdev;
 	struct bio_set *bset = under_dev->bset;
 	struct bio *new_bio;
@@ -146,9 +148,15 @@ static blk_status_t lz4e_write_req_init(struct lz4e_req *lzreq,
 					struct lz4e_dev *lzdev)
 {
 	struct lz4e_stats *stats_to_update = lzdev->write_stats;
+	int acceleration = READ_ONCE(lzdev->acceleration);
+	int hc_level = READ_ONCE(lzdev->hc_level);
+	int probe_size = READ_ONCE(lzdev->probe_size);
+	int dec_speed = READ_ONCE(lzdev->dec_speed);
 	struct lz4e_chunk *chunk;
 	struct bio *new_bio;
 	blk_status_t status;
+	struct lz4e_wrkmem *wrkmem;
+	unsigned long pattern;
 	int ret;
 
 	chunk = lz4e_chunk_alloc((int)original_bio->bi_iter.bi_size);
@@ -174,18 +182,46 @@ static blk_status_t lz4e_write_req_init(struct lz4e_req *lzreq,
 	chunk->src_buf.bio = original_bio;
 	chunk->dst_buf.bio = new_bio;
 
-	ret = lz4e_chunk_compress_ext(chunk);
+	// Same-filled data, such as zero pages, is stored as is without being
+	// compressed, so the compression does not check it again.
+	// Large bios are cut into independent blocks compressed on all CPUs
+	if (LZ4E_same_filled(original_bio->bi_io_vec, original_bio->bi_iter,
+			     &pattern)) {
+		chunk->same_filled = true;
+		ret = 0;
+
+		LZ4E_PR_INFO("data is filled with pattern %#lx", pattern);
+	} else if (original_bio->bi_iter.bi_size >= LZ4E_PAR_MIN_SIZE &&
+		   num_online_cpus() > 1) {
+		ret = lz4e_chunk_compress_par(chunk, lzdev, acceleration,
+					      hc_level, probe_size, dec_speed);
+	} else if (hc_level) {
+		wrkmem = lz4e_wrkmem_get(lzdev);
+		ret = lz4e_chunk_compress_hc(chunk, wrkmem->hc, hc_level,
+					     dec_speed);
+		lz4e_wrkmem_put(wrkmem);
+	} else {
+		wrkmem = lz4e_wrkmem_get(lzdev);
+		ret = lz4e_chunk_compress_ext(chunk, wrkmem->fast, acceleration,
+					      probe_size, dec_speed);
+		lz4e_wrkmem_put(wrkmem);
+	}
 	if (ret) {
 		LZ4E_PR_ERR("failed to compress data");
 		status = BLK_STS_IOERR;
 		goto put_new_bio;
 	}
 
-	ret = lz4e_chunk_decompress(chunk);
-	if (ret) {
-		LZ4E_PR_ERR("failed to decompress data");
-		status = BLK_STS_IOERR;
-		goto put_new_bio;
+	// Data that was not compressed skips the round trip and is written as is
+	if (chunk->raw || chunk->same_filled) {
+		lz4e_buf_copy_from_bio(&chunk->src_buf, original_bio);
+	} else {
+		ret = lz4e_chunk_decompress(chunk);
+		if (ret) {
+			LZ4E_PR_ERR("failed to decompress data");
+			status = BLK_STS_IOERR;
+			goto put_new_bio;
+		}
 	}
 
 	lz4e_reset_bio(new_bio, original_bio, lzdev->under_dev);
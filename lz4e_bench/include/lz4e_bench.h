@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+#ifndef LZ4E_BENCH_H
+#define LZ4E_BENCH_H
+
+#include <linux/bvec.h>
+#include <linux/mm_types.h>
+#include <linux/printk.h>
+#include <linux/types.h>
+
+#include "include/lz4e.h"
+
+#define LZ4E_BENCH_MODULE_NAME "lz4e_bench"
+
+// Default and maximal input size. The compressed output of the fragmented
+// layout has to fit into LZ4E_SEG_MAX segments as well.
+#define LZ4E_BENCH_DEFAULT_SIZE (64 * 1024)
+#define LZ4E_BENCH_MAX_SIZE (64 * 1024)
+
+#define LZ4E_BENCH_DEFAULT_ITERATIONS 100
+#define LZ4E_BENCH_MAX_ITERATIONS 100000
+
+// Segment length of the fragmented layout
+#define LZ4E_BENCH_FRAG_SIZE 512
+
+// Print formatted error to logs
+#define LZ4E_BENCH_PR_ERR(fmt, ...) \
+	pr_err("%s: " fmt "\n", LZ4E_BENCH_MODULE_NAME, ##__VA_ARGS__)
+
+// Print formatted info to logs
+#define LZ4E_BENCH_PR_INFO(fmt, ...) \
+	pr_info("%s: " fmt "\n", LZ4E_BENCH_MODULE_NAME, ##__VA_ARGS__)
+
+// Synthetic data to compress
+enum lz4e_bench_corpus {
+	LZ4E_BENCH_TEXT,
+	LZ4E_BENCH_ZEROS,
+	LZ4E_BENCH_RANDOM,
+	LZ4E_BENCH_MIXED,
+	LZ4E_BENCH_CORPUS_COUNT,
+};
+
+// Ways to split a buffer into segments
+enum lz4e_bench_layout {
+	LZ4E_BENCH_SINGLE, // one segment over contiguous pages
+	LZ4E_BENCH_PAGES, // whole pages
+	LZ4E_BENCH_FRAGS, // 512 byte fragments, none adjacent in memory
+	LZ4E_BENCH_MISALIGNED, // one per page at an odd offset
+	LZ4E_BENCH_LAYOUT_COUNT,
+};
+
+// Struct representing the benchmark module
+struct lz4e_bench_module {
+	unsigned int size;
+	unsigned int iterations;
+	char *table; // results of the last run, NULL if there were none
+};
+
+// Pages holding the segments of a buffer
+struct lz4e_bench_pool {
+	struct page *pages;
+	unsigned int order;
+};
+
+// Struct representing a buffer split into segments
+struct lz4e_bench_buf {
+	struct bio_vec bvecs[LZ4E_SEG_MAX];
+	int count;
+	unsigned int capacity;
+};
+
+// Fill data with the given corpus, the same for every run
+void lz4e_bench_fill(char *data, unsigned int size,
+		     enum lz4e_bench_corpus corpus);
+
+// Get name of the corpus
+const char *lz4e_bench_corpus_name(enum lz4e_bench_corpus corpus);
+
+// Run the benchmark over all layouts and corpora, writing a table into buf
+int lz4e_bench_run(unsigned int size, unsigned int iterations, char *buf,
+		   size_t buf_size);
+
+#endif
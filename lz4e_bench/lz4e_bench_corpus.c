@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/minmax.h>
+#include <linux/prandom.h>
+#include <linux/string.h>
+
+#include "include/lz4e_bench.h"
+
+// Fixed seed, so that every run compresses the same data
+#define LZ4E_BENCH_SEED 0x6c7a3465ULL
+
+// Length of the runs the mixed corpus switches between
+#define LZ4E_BENCH_MIXED_RUN 1024
+
+// Text corpus is made of random snippets of this paragraph
+static const char lz4e_bench_paragraph[] =
+	"A block device proxy compresses every write request before passing "
+	"it to the underlying device, and decompresses it back on read. The "
+	"data of a request is scattered over pages, which are described by "
+	"segments of a bio, so the compressor walks over them with iterators "
+	"instead of copying them into a contiguous buffer first.\n";
+
+#define LZ4E_BENCH_SNIPPET_MIN 8
+#define LZ4E_BENCH_SNIPPET_RANGE 64
+
+static const char *const lz4e_bench_corpus_names[] = {
+	[LZ4E_BENCH_TEXT] = "text",
+	[LZ4E_BENCH_ZEROS] = "zeros",
+	[LZ4E_BENCH_RANDOM] = "random",
+	[LZ4E_BENCH_MIXED] = "mixed",
+};
+
+static void lz4e_bench_fill_text(char *data, unsigned int size,
+				 struct rnd_state *rnd)
+{
+	const unsigned int text_len = sizeof(lz4e_bench_paragraph) - 1;
+	unsigned int pos = 0;
+
+	while (pos < size) {
+		u32 r = prandom_u32_state(rnd);
+		unsigned int start = (r & 0xffff) % text_len;
+		unsigned int len = (r >> 16) % LZ4E_BENCH_SNIPPET_RANGE;
+
+		len = min3(LZ4E_BENCH_SNIPPET_MIN + len, text_len - start,
+			   size - pos);
+		memcpy(data + pos, lz4e_bench_paragraph + start, len);
+		pos += len;
+	}
+}
+
+static void lz4e_bench_fill_mixed(char *data, unsigned int size,
+				  struct rnd_state *rnd)
+{
+	unsigned int pos;
+
+	// Text, text, random bytes and zeros in turn
+	for (pos = 0; pos < size; pos += LZ4E_BENCH_MIXED_RUN) {
+		unsigned int len = min_t(unsigned int, size - pos,
+					 LZ4E_BENCH_MIXED_RUN);
+
+		switch ((pos / LZ4E_BENCH_MIXED_RUN) % 4) {
+		case 0:
+		case 1:
+			lz4e_bench_fill_text(data + pos, len, rnd);
+			break;
+		case 2:
+			prandom_bytes_state(rnd, data + pos, len);
+			break;
+		default:
+			memset(data + pos, 0, len);
+			break;
+		}
+	}
+}
+
+void lz4e_bench_fill(char *data, unsigned int size,
+		     enum lz4e_bench_corpus corpus)
+{
+	struct rnd_state rnd;
+
+	prandom_seed_state(&rnd, LZ4E_BENCH_SEED + corpus);
+
+	switch (corpus) {
+	case LZ4E_BENCH_TEXT:
+		lz4e_bench_fill_text(data, size, &rnd);
+		break;
+	case LZ4E_BENCH_ZEROS:
+		memset(data, 0, size);
+		break;
+	case LZ4E_BENCH_RANDOM:
+		prandom_bytes_state(&rnd, data, size);
+		break;
+	default:
+		lz4e_bench_fill_mixed(data, size, &rnd);
+		break;
+	}
+}
+
+const char *lz4e_bench_corpus_name(enum lz4e_bench_corpus corpus)
+{
+	return lz4e_bench_corpus_names[corpus];
+}
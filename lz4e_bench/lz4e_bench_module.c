@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/kstrtox.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/stat.h>
+#include <linux/sysfs.h>
+
+#include "include/lz4e_bench.h"
+
+static struct lz4e_bench_module benchmod = {
+	.size = LZ4E_BENCH_DEFAULT_SIZE,
+	.iterations = LZ4E_BENCH_DEFAULT_ITERATIONS,
+};
+
+// Callbacks can have unused parameters
+// NOLINTBEGIN(misc-unused-parameters)
+
+static int lz4e_bench_set_size(const char *arg, const struct kernel_param *kpar)
+{
+	unsigned int size;
+	int ret;
+
+	ret = kstrtouint(arg, 0, &size);
+	if (ret) {
+		LZ4E_BENCH_PR_ERR("failed to parse input size");
+		return ret;
+	}
+
+	if (size < 1 || size > LZ4E_BENCH_MAX_SIZE) {
+		LZ4E_BENCH_PR_ERR("input size must be in range [1, %d]",
+				  LZ4E_BENCH_MAX_SIZE);
+		return -EINVAL;
+	}
+
+	benchmod.size = size;
+
+	LZ4E_BENCH_PR_INFO("input size set to %u", size);
+	return 0;
+}
+
+static int lz4e_bench_get_size(char *buf, const struct kernel_param *kpar)
+{
+	int ret = sysfs_emit(buf, "%u\n", benchmod.size);
+
+	if (ret < 0)
+		LZ4E_BENCH_PR_ERR("failed to write input size");
+
+	return ret;
+}
+
+static int lz4e_bench_set_iterations(const char *arg,
+				     const struct kernel_param *kpar)
+{
+	unsigned int iterations;
+	int ret;
+
+	ret = kstrtouint(arg, 0, &iterations);
+	if (ret) {
+		LZ4E_BENCH_PR_ERR("failed to parse iterations");
+		return ret;
+	}
+
+	if (iterations < 1 || iterations > LZ4E_BENCH_MAX_ITERATIONS) {
+		LZ4E_BENCH_PR_ERR("iterations must be in range [1, %d]",
+				  LZ4E_BENCH_MAX_ITERATIONS);
+		return -EINVAL;
+	}
+
+	benchmod.iterations = iterations;
+
+	LZ4E_BENCH_PR_INFO("iterations set to %u", iterations);
+	return 0;
+}
+
+static int lz4e_bench_get_iterations(char *buf,
+				     const struct kernel_param *kpar)
+{
+	int ret = sysfs_emit(buf, "%u\n", benchmod.iterations);
+
+	if (ret < 0)
+		LZ4E_BENCH_PR_ERR("failed to write iterations");
+
+	return ret;
+}
+
+static int lz4e_bench_start(const char *arg, const struct kernel_param *kpar)
+{
+	int ret;
+
+	if (!benchmod.table) {
+		benchmod.table = kzalloc(PAGE_SIZE, GFP_KERNEL);
+		if (!benchmod.table) {
+			LZ4E_BENCH_PR_ERR("failed to allocate result table");
+			return -ENOMEM;
+		}
+	}
+
+	ret = lz4e_bench_run(benchmod.size, benchmod.iterations,
+			     benchmod.table, PAGE_SIZE);
+	if (ret) {
+		LZ4E_BENCH_PR_ERR("benchmark failed");
+		goto free_table;
+	}
+
+	LZ4E_BENCH_PR_INFO("benchmark finished");
+	return 0;
+
+free_table:
+	kfree(benchmod.table);
+	benchmod.table = NULL;
+	return ret;
+}
+
+static int lz4e_bench_get_table(char *buf, const struct kernel_param *kpar)
+{
+	int ret;
+
+	if (!benchmod.table) {
+		LZ4E_BENCH_PR_ERR("no benchmark results");
+		return -ENODATA;
+	}
+
+	ret = sysfs_emit(buf, "%s", benchmod.table);
+	if (ret < 0)
+		LZ4E_BENCH_PR_ERR("failed to write benchmark results");
+
+	return ret;
+}
+
+// Callbacks can have unused parameters
+// NOLINTEND(misc-unused-parameters)
+
+static int __init lz4e_bench_init(void)
+{
+	LZ4E_BENCH_PR_INFO("module loaded successfully");
+	return 0;
+}
+
+static void __exit lz4e_bench_exit(void)
+{
+	kfree(benchmod.table);
+	benchmod.table = NULL;
+
+	LZ4E_BENCH_PR_INFO("module unloaded successfully");
+}
+
+static const struct kernel_param_ops lz4e_bench_size_ops = {
+	.set = lz4e_bench_set_size,
+	.get = lz4e_bench_get_size,
+};
+
+static const struct kernel_param_ops lz4e_bench_iterations_ops = {
+	.set = lz4e_bench_set_iterations,
+	.get = lz4e_bench_get_iterations,
+};
+
+static const struct kernel_param_ops lz4e_bench_run_ops = {
+	.set = lz4e_bench_start,
+	.get = lz4e_bench_get_table,
+};
+
+module_param_cb(size, &lz4e_bench_size_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(size, "Input size of the benchmark in bytes");
+
+module_param_cb(iterations, &lz4e_bench_iterations_ops, NULL,
+		S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(iterations, "Times every operation is repeated");
+
+module_param_cb(run, &lz4e_bench_run_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(run, "Run the benchmark, read to get the results");
+
+module_init(lz4e_bench_init);
+module_exit(lz4e_bench_exit);
+
+MODULE_AUTHOR("Alexander Bugaev");
+MODULE_DESCRIPTION("Benchmark of extended LZ4 over segment layouts");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,432 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/bvec.h>
+#include <linux/errno.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sprintf.h>
+#include <linux/string.h>
+#include <linux/time64.h>
+#include <linux/vmalloc.h>
+
+#include "include/lz4e.h"
+#include "include/lz4e_bench.h"
+
+// Operations measured for every layout and corpus
+enum lz4e_bench_op {
+	LZ4E_BENCH_LZ4E_COMPRESS,
+	LZ4E_BENCH_LZ4_COMPRESS,
+	LZ4E_BENCH_LZ4E_DECOMPRESS,
+	LZ4E_BENCH_LZ4_DECOMPRESS,
+	LZ4E_BENCH_OP_COUNT,
+};
+
+// Buffers and working memory of a benchmark run
+struct lz4e_bench_ctx {
+	unsigned int size;
+	unsigned int bound;
+	unsigned int iterations;
+	struct lz4e_bench_pool src_pool;
+	struct lz4e_bench_pool cmp_pool;
+	struct lz4e_bench_pool dec_pool;
+	struct lz4e_bench_buf src;
+	struct lz4e_bench_buf cmp;
+	struct lz4e_bench_buf dec;
+	char *data; // input, also the linear source of upstream LZ4
+	char *lin_cmp; // compressed output of upstream LZ4
+	char *lin_dec; // decompressed output, also used for checks
+	void *lz4e_wrkmem;
+	void *lz4_wrkmem;
+};
+
+// Results of all operations for a layout and a corpus
+struct lz4e_bench_result {
+	int cmp_size[LZ4E_BENCH_OP_COUNT];
+	u64 time_ns[LZ4E_BENCH_OP_COUNT];
+};
+
+static const char *const lz4e_bench_layout_names[] = {
+	[LZ4E_BENCH_SINGLE] = "single",
+	[LZ4E_BENCH_PAGES] = "pages",
+	[LZ4E_BENCH_FRAGS] = "frags512",
+	[LZ4E_BENCH_MISALIGNED] = "misaligned",
+};
+
+static int lz4e_bench_pool_alloc(struct lz4e_bench_pool *pool,
+				 unsigned int size)
+{
+	// One spare page, since not every layout starts at offset zero
+	pool->order = get_order(size + PAGE_SIZE);
+	pool->pages = alloc_pages(GFP_KERNEL, pool->order);
+
+	return pool->pages ? 0 : -ENOMEM;
+}
+
+static void lz4e_bench_pool_free(struct lz4e_bench_pool *pool)
+{
+	if (pool->pages)
+		__free_pages(pool->pages, pool->order);
+}
+
+// Describe len bytes of the pool as segments of the given layout
+static int lz4e_bench_split(struct lz4e_bench_buf *buf,
+			    struct lz4e_bench_pool *pool,
+			    enum lz4e_bench_layout layout, unsigned int len)
+{
+	const unsigned int pages = 1U << pool->order;
+	unsigned int pos = 0;
+	int i;
+
+	if (layout == LZ4E_BENCH_SINGLE) {
+		bvec_set_page(&buf->bvecs[0], pool->pages, len, 0);
+		buf->count = 1;
+		buf->capacity = len;
+		return 0;
+	}
+
+	for (i = 0; pos < len; i++) {
+		unsigned int page_idx = i;
+		unsigned int offset = 0;
+		unsigned int seg_len = PAGE_SIZE;
+
+		if (layout == LZ4E_BENCH_FRAGS) {
+			// Neighbouring fragments lie in different pages
+			page_idx = i % pages;
+			offset = i / pages * LZ4E_BENCH_FRAG_SIZE;
+			seg_len = LZ4E_BENCH_FRAG_SIZE;
+		} else if (layout == LZ4E_BENCH_MISALIGNED) {
+			offset = 1 + 2 * (i % 32);
+			seg_len = PAGE_SIZE - offset;
+		}
+
+		if (i == LZ4E_SEG_MAX || page_idx >= pages ||
+		    offset + seg_len > PAGE_SIZE)
+			return -E2BIG;
+
+		seg_len = min(seg_len, len - pos);
+		bvec_set_page(&buf->bvecs[i], pool->pages + page_idx, seg_len,
+			      offset);
+		pos += seg_len;
+	}
+
+	buf->count = i;
+	buf->capacity = len;
+	return 0;
+}
+
+static void lz4e_bench_scatter(struct lz4e_bench_buf *buf, const char *data,
+			       unsigned int len)
+{
+	struct bvec_iter start = { .bi_size = len };
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+
+	for_each_bvec (bvec, buf->bvecs, iter, start) {
+		memcpy_to_bvec(&bvec, data);
+		data += bvec.bv_len;
+	}
+}
+
+static void lz4e_bench_gather(char *data, struct lz4e_bench_buf *buf,
+			      unsigned int len)
+{
+	struct bvec_iter start = { .bi_size = len };
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+
+	for_each_bvec (bvec, buf->bvecs, iter, start) {
+		memcpy_from_bvec(data, &bvec);
+		data += bvec.bv_len;
+	}
+}
+
+static void lz4e_bench_ctx_free(struct lz4e_bench_ctx *ctx)
+{
+	lz4e_bench_pool_free(&ctx->src_pool);
+	lz4e_bench_pool_free(&ctx->cmp_pool);
+	lz4e_bench_pool_free(&ctx->dec_pool);
+	vfree(ctx->data);
+	vfree(ctx->lin_cmp);
+	vfree(ctx->lin_dec);
+	vfree(ctx->lz4e_wrkmem);
+	vfree(ctx->lz4_wrkmem);
+	kvfree(ctx);
+}
+
+static struct lz4e_bench_ctx *lz4e_bench_ctx_alloc(unsigned int size,
+						   unsigned int iterations)
+{
+	struct lz4e_bench_ctx *ctx = kvzalloc(sizeof(*ctx), GFP_KERNEL);
+
+	if (!ctx)
+		return NULL;
+
+	ctx->size = size;
+	ctx->bound = LZ4E_COMPRESSBOUND(size);
+	ctx->iterations = iterations;
+
+	if (lz4e_bench_pool_alloc(&ctx->src_pool, size) ||
+	    lz4e_bench_pool_alloc(&ctx->cmp_pool, ctx->bound) ||
+	    lz4e_bench_pool_alloc(&ctx->dec_pool, size))
+		goto free_ctx;
+
+	ctx->data = vmalloc(size);
+	ctx->lin_cmp = vmalloc(ctx->bound);
+	ctx->lin_dec = vmalloc(size);
+	// Working memory of LZ4E has to be zeroed before the first use
+	ctx->lz4e_wrkmem = vzalloc(LZ4E_MEM_COMPRESS);
+	ctx->lz4_wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+
+	if (!ctx->data || !ctx->lin_cmp || !ctx->lin_dec ||
+	    !ctx->lz4e_wrkmem || !ctx->lz4_wrkmem)
+		goto free_ctx;
+
+	return ctx;
+
+free_ctx:
+	lz4e_bench_ctx_free(ctx);
+	return NULL;
+}
+
+// Run the operation once, returning the number of bytes it produced
+static int lz4e_bench_op_run(struct lz4e_bench_ctx *ctx, enum lz4e_bench_op op,
+			     int cmp_size)
+{
+	struct bvec_iter src_iter;
+	struct bvec_iter dst_iter;
+
+	switch (op) {
+	case LZ4E_BENCH_LZ4E_COMPRESS:
+		src_iter = (struct bvec_iter){ .bi_size = ctx->size };
+		dst_iter = (struct bvec_iter){ .bi_size = ctx->cmp.capacity };
+		return LZ4E_compress_default(ctx->src.bvecs, ctx->cmp.bvecs,
+					     &src_iter, &dst_iter,
+					     ctx->lz4e_wrkmem);
+	case LZ4E_BENCH_LZ4_COMPRESS:
+		return LZ4_compress_default(ctx->data, ctx->lin_cmp, ctx->size,
+					    ctx->bound, ctx->lz4_wrkmem);
+	case LZ4E_BENCH_LZ4E_DECOMPRESS:
+		src_iter = (struct bvec_iter){ .bi_size = cmp_size };
+		dst_iter = (struct bvec_iter){ .bi_size = ctx->size };
+		return LZ4E_decompress_safe(ctx->cmp.bvecs, ctx->dec.bvecs,
+					    &src_iter, &dst_iter);
+	default:
+		return LZ4_decompress_safe(ctx->lin_cmp, ctx->lin_dec, cmp_size,
+					   ctx->size);
+	}
+}
+
+// Repeat the operation, keeping the total time and the size it produced
+static int lz4e_bench_op_time(struct lz4e_bench_ctx *ctx,
+			      struct lz4e_bench_result *res,
+			      enum lz4e_bench_op op, int cmp_size)
+{
+	u64 start = ktime_get_ns();
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < ctx->iterations; i++) {
+		ret = lz4e_bench_op_run(ctx, op, cmp_size);
+		if (ret <= 0)
+			return -EIO;
+
+		cond_resched();
+	}
+
+	res->time_ns[op] = ktime_get_ns() - start;
+	res->cmp_size[op] = ret;
+	return 0;
+}
+
+// Measure upstream LZ4 on the linear copy of the data
+static int lz4e_bench_lz4(struct lz4e_bench_ctx *ctx,
+			  struct lz4e_bench_result *res)
+{
+	int ret;
+
+	ret = lz4e_bench_op_time(ctx, res, LZ4E_BENCH_LZ4_COMPRESS, 0);
+	if (ret)
+		return ret;
+
+	ret = lz4e_bench_op_time(ctx, res, LZ4E_BENCH_LZ4_DECOMPRESS,
+				 res->cmp_size[LZ4E_BENCH_LZ4_COMPRESS]);
+	if (ret)
+		return ret;
+
+	if (memcmp(ctx->data, ctx->lin_dec, ctx->size))
+		return -EIO;
+
+	return 0;
+}
+
+// Measure LZ4E on the data split into segments of the given layout
+static int lz4e_bench_lz4e(struct lz4e_bench_ctx *ctx,
+			   struct lz4e_bench_result *res,
+			   enum lz4e_bench_layout layout)
+{
+	int ret;
+
+	ret = lz4e_bench_split(&ctx->src, &ctx->src_pool, layout, ctx->size);
+	if (ret)
+		return ret;
+
+	ret = lz4e_bench_split(&ctx->cmp, &ctx->cmp_pool, layout, ctx->bound);
+	if (ret)
+		return ret;
+
+	ret = lz4e_bench_split(&ctx->dec, &ctx->dec_pool, layout, ctx->size);
+	if (ret)
+		return ret;
+
+	lz4e_bench_scatter(&ctx->src, ctx->data, ctx->size);
+
+	ret = lz4e_bench_op_time(ctx, res, LZ4E_BENCH_LZ4E_COMPRESS, 0);
+	if (ret)
+		return ret;
+
+	ret = lz4e_bench_op_time(ctx, res, LZ4E_BENCH_LZ4E_DECOMPRESS,
+				 res->cmp_size[LZ4E_BENCH_LZ4E_COMPRESS]);
+	if (ret)
+		return ret;
+
+	lz4e_bench_gather(ctx->lin_dec, &ctx->dec, ctx->size);
+	if (memcmp(ctx->data, ctx->lin_dec, ctx->size))
+		return -EIO;
+
+	return 0;
+}
+
+// Speed in MB/s, that is in bytes per microsecond
+static u64 lz4e_bench_speed(struct lz4e_bench_ctx *ctx,
+			    struct lz4e_bench_result *res,
+			    enum lz4e_bench_op op)
+{
+	u64 bytes = (u64)ctx->size * ctx->iterations * NSEC_PER_USEC;
+
+	return div64_u64(bytes, max_t(u64, res->time_ns[op], 1));
+}
+
+// Print compression ratio with two decimal places
+static void lz4e_bench_ratio(char *buf, size_t buf_size, unsigned int size,
+			     int cmp_size)
+{
+	unsigned int ratio = (unsigned int)div_u64((u64)size * 100, cmp_size);
+
+	scnprintf(buf, buf_size, "%u.%02u", ratio / 100, ratio % 100);
+}
+
+static int lz4e_bench_print(struct lz4e_bench_ctx *ctx,
+			    struct lz4e_bench_result *res,
+			    enum lz4e_bench_layout layout,
+			    enum lz4e_bench_corpus corpus, char *buf,
+			    size_t buf_size)
+{
+	char ratio[16];
+	char lz4_ratio[16];
+
+	lz4e_bench_ratio(ratio, sizeof(ratio), ctx->size,
+			 res->cmp_size[LZ4E_BENCH_LZ4E_COMPRESS]);
+	lz4e_bench_ratio(lz4_ratio, sizeof(lz4_ratio), ctx->size,
+			 res->cmp_size[LZ4E_BENCH_LZ4_COMPRESS]);
+
+	return scnprintf(buf, buf_size,
+			 "%-10s %-6s %4d %6s %6s %8llu %8llu %10llu %8llu\n",
+			 lz4e_bench_layout_names[layout],
+			 lz4e_bench_corpus_name(corpus), ctx->src.count, ratio,
+			 lz4_ratio,
+			 lz4e_bench_speed(ctx, res, LZ4E_BENCH_LZ4E_COMPRESS),
+			 lz4e_bench_speed(ctx, res, LZ4E_BENCH_LZ4_COMPRESS),
+			 lz4e_bench_speed(ctx, res, LZ4E_BENCH_LZ4E_DECOMPRESS),
+			 lz4e_bench_speed(ctx, res, LZ4E_BENCH_LZ4_DECOMPRESS));
+}
+
+// Measure LZ4E on every corpus split into the given layout, appending the
+// rows to buf. Returns the number of bytes written or a negative error.
+static int lz4e_bench_layout(struct lz4e_bench_ctx *ctx,
+			     struct lz4e_bench_result *res,
+			     enum lz4e_bench_layout layout, char *buf,
+			     size_t buf_size)
+{
+	int corpus;
+	int len = 0;
+	int ret;
+
+	for (corpus = 0; corpus < LZ4E_BENCH_CORPUS_COUNT; corpus++) {
+		lz4e_bench_fill(ctx->data, ctx->size, corpus);
+
+		ret = lz4e_bench_lz4e(ctx, &res[corpus], layout);
+		if (ret) {
+			LZ4E_BENCH_PR_ERR("LZ4E failed on %s/%s",
+					  lz4e_bench_layout_names[layout],
+					  lz4e_bench_corpus_name(corpus));
+			return ret;
+		}
+
+		len += lz4e_bench_print(ctx, &res[corpus], layout, corpus,
+					buf + len, buf_size - len);
+	}
+
+	return len;
+}
+
+int lz4e_bench_run(unsigned int size, unsigned int iterations, char *buf,
+		   size_t buf_size)
+{
+	struct lz4e_bench_result res[LZ4E_BENCH_CORPUS_COUNT] = {};
+	struct lz4e_bench_ctx *ctx;
+	int layout;
+	int corpus;
+	size_t len;
+	int ret;
+
+	ctx = lz4e_bench_ctx_alloc(size, iterations);
+	if (!ctx) {
+		LZ4E_BENCH_PR_ERR("failed to allocate buffers");
+		return -ENOMEM;
+	}
+
+	len = scnprintf(buf, buf_size,
+			"input: %u bytes, %u iterations, speed in MB/s\n"
+			"%-10s %-6s %4s %6s %6s %8s %8s %10s %8s\n",
+			size, iterations, "layout", "corpus", "segs", "ratio",
+			"lz4", "compress", "lz4", "decompress", "lz4");
+
+	// Upstream LZ4 does not depend on the layout, so it runs only once
+	for (corpus = 0; corpus < LZ4E_BENCH_CORPUS_COUNT; corpus++) {
+		lz4e_bench_fill(ctx->data, size, corpus);
+
+		ret = lz4e_bench_lz4(ctx, &res[corpus]);
+		if (ret) {
+			LZ4E_BENCH_PR_ERR("upstream LZ4 failed on %s",
+					  lz4e_bench_corpus_name(corpus));
+			goto free_ctx;
+		}
+	}
+
+	for (layout = 0; layout < LZ4E_BENCH_LAYOUT_COUNT; layout++) {
+		ret = lz4e_bench_layout(ctx, res, layout, buf + len,
+					buf_size - len);
+		if (ret < 0)
+			goto free_ctx;
+
+		len += ret;
+	}
+
+	ret = 0;
+
+free_ctx:
+	lz4e_bench_ctx_free(ctx);
+	return ret;
+}
@@ -0,0 +1,171 @@
+#ifndef LZ4E_IOV
+#define LZ4E_IOV
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define LZ4E_IOV_API __attribute__((__visibility__("default")))
+
+/* Maximum number of non-empty entries in a single iovec array */
+#define LZ4E_IOV_MAX 256
+
+/* Input bytes of every block of LZ4E_compress_blocks_iov(), but the last */
+#define LZ4E_IOV_BLOCK_SIZE (64 * 1024)
+
+/*
+ * LZ4E_sizeofState() - size of the working memory for LZ4E_compress_iov().
+ * The memory must be zeroed before the first use, e.g. allocated with
+ * calloc(). It can then be reused for subsequent calls without clearing.
+ */
+LZ4E_IOV_API int LZ4E_sizeofState(void);
+
+/*
+ * LZ4E_sizeofStateHC() - size of the working memory for
+ * LZ4E_compress_HC_iov(), with the same requirements as above
+ */
+LZ4E_IOV_API int LZ4E_sizeofStateHC(void);
+
+/*
+ * LZ4E_sizeofStreamDecode() - size of the state for
+ * LZ4E_decompress_safe_continue_iov(). A zeroed state starts a stream.
+ */
+LZ4E_IOV_API int LZ4E_sizeofStreamDecode(void);
+
+/*
+ * LZ4E_compressBound() - maximum size of a block compressed from
+ * 'inputSize' bytes, or 0 if the input is too large to be compressed
+ */
+LZ4E_IOV_API int LZ4E_compressBound(int inputSize);
+
+/*
+ * LZ4E_blocksBound() - maximum size of the output of
+ * LZ4E_compress_blocks_iov() for 'inputSize' bytes, or 0 if the input is
+ * too large to be compressed
+ */
+LZ4E_IOV_API int LZ4E_blocksBound(int inputSize);
+
+/*
+ * LZ4E_compress_iov() - compress the data described by 'srcCnt' entries of
+ * 'src' into the buffers described by 'dstCnt' entries of 'dst', in the
+ * same way as readv()/writev() consume them. Both arrays may have at most
+ * LZ4E_IOV_MAX non-empty entries. Values of 'acceleration' below 1 select
+ * the default one. The output is a standard LZ4 block.
+ * Returns the number of bytes written into 'dst', or 0 on failure.
+ */
+LZ4E_IOV_API int LZ4E_compress_iov(const struct iovec *src, int srcCnt,
+				   const struct iovec *dst, int dstCnt,
+				   int acceleration, void *state);
+
+/*
+ * LZ4E_compress_fast_xxh32_iov() - same as LZ4E_compress_iov(), but also
+ * computes the xxHash32 (seed 0) of the input into '*checksum' on success.
+ * 'checksum' may be NULL.
+ */
+LZ4E_IOV_API int LZ4E_compress_fast_xxh32_iov(const struct iovec *src,
+					      int srcCnt,
+					      const struct iovec *dst,
+					      int dstCnt, int acceleration,
+					      uint32_t *checksum, void *state);
+
+/*
+ * LZ4E_compress_blocks_iov() - same as LZ4E_compress_iov(), but the output
+ * is a sequence of independent blocks of LZ4E_IOV_BLOCK_SIZE input bytes,
+ * preceded by an index of their sizes. 'dst' should hold
+ * LZ4E_blocksBound() bytes for the compression to always succeed.
+ */
+LZ4E_IOV_API int LZ4E_compress_blocks_iov(const struct iovec *src,
+					  int srcCnt, const struct iovec *dst,
+					  int dstCnt, int acceleration,
+					  void *state);
+
+/*
+ * LZ4E_compress_HC_iov() - same as LZ4E_compress_iov(), but with the high
+ * compression algorithm. Values of 'compressionLevel' below 1 select the
+ * default level.
+ */
+LZ4E_IOV_API int LZ4E_compress_HC_iov(const struct iovec *src, int srcCnt,
+				      const struct iovec *dst, int dstCnt,
+				      int compressionLevel, void *state);
+
+/*
+ * LZ4E_compress_destSize_iov() - compress as much of the data described by
+ * 'src' as fits into the buffers described by 'dst', which are filled as
+ * far as possible. The number of consumed input bytes is written to
+ * '*srcSizePtr'.
+ * Returns the number of bytes written into 'dst', or 0 on failure.
+ */
+LZ4E_IOV_API int LZ4E_compress_destSize_iov(const struct iovec *src,
+					    int srcCnt,
+					    const struct iovec *dst,
+					    int dstCnt, int *srcSizePtr,
+					    void *state);
+
+/*
+ * LZ4E_compress_fast_continue_iov() - same as LZ4E_compress_iov(), but the
+ * block may reference up to 64KB of the data compressed before it with the
+ * same 'state', which has to stay in place until the next call. A zeroed
+ * state starts a stream.
+ */
+LZ4E_IOV_API int LZ4E_compress_fast_continue_iov(const struct iovec *src,
+						 int srcCnt,
+						 const struct iovec *dst,
+						 int dstCnt, int acceleration,
+						 void *state);
+
+/*
+ * LZ4E_decompress_iov() - decompress a block described by 'srcCnt' entries
+ * of 'src' into the buffers described by 'dstCnt' entries of 'dst'.
+ * The whole of 'src' is taken as the compressed block.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+LZ4E_IOV_API int LZ4E_decompress_iov(const struct iovec *src, int srcCnt,
+				     const struct iovec *dst, int dstCnt);
+
+/*
+ * LZ4E_decompress_safe_xxh32_iov() - same as LZ4E_decompress_iov(), but
+ * also verifies the decompressed data against '*checksum', an xxHash32
+ * (seed 0) of the original input, and fails on mismatch. 'checksum' may
+ * be NULL.
+ */
+LZ4E_IOV_API int LZ4E_decompress_safe_xxh32_iov(const struct iovec *src,
+						int srcCnt,
+						const struct iovec *dst,
+						int dstCnt,
+						const uint32_t *checksum);
+
+/*
+ * LZ4E_decompress_blocks_iov() - decompress all blocks produced by
+ * LZ4E_compress_blocks_iov(). The whole of 'src' is taken as the
+ * compressed data.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+LZ4E_IOV_API int LZ4E_decompress_blocks_iov(const struct iovec *src,
+					    int srcCnt,
+					    const struct iovec *dst,
+					    int dstCnt);
+
+/*
+ * LZ4E_decompress_block_iov() - decompress only the block 'blockIdx' of
+ * the data produced by LZ4E_compress_blocks_iov(), which holds the input
+ * bytes starting from 'blockIdx * LZ4E_IOV_BLOCK_SIZE'. The whole of 'src'
+ * is taken as the compressed data.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+LZ4E_IOV_API int LZ4E_decompress_block_iov(const struct iovec *src,
+					   int srcCnt,
+					   const struct iovec *dst,
+					   int dstCnt, unsigned int blockIdx);
+
+/*
+ * LZ4E_decompress_safe_continue_iov() - decompress the next block of
+ * a stream produced by LZ4E_compress_fast_continue_iov(). The previous 64KB
+ * of decompressed data have to stay in place, wherever they were written.
+ * Returns the number of decompressed bytes, or a negative value on error.
+ */
+LZ4E_IOV_API int LZ4E_decompress_safe_continue_iov(const struct iovec *src,
+						   int srcCnt,
+						   const struct iovec *dst,
+						   int dstCnt,
+						   void *streamDecode);
+
+#endif
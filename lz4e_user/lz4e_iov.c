@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * iovec interface of the userspace build. Entries of an iovec array are
+ * described as bio_vecs over the same memory (see shim/lz4e_shim.h) and
+ * passed to the library, so scattered buffers are never gathered.
+ */
+
+#include <linux/bio.h>
+#include <linux/bvec.h>
+
+#include "lz4e_iov.h"
+
+#include "lz4e.h"
+
+_Static_assert(LZ4E_IOV_MAX == LZ4E_SEG_MAX,
+	       "LZ4E_IOV_MAX has to match the segment limit of the library");
+_Static_assert(LZ4E_IOV_BLOCK_SIZE == LZ4E_BLOCK_SIZE,
+	       "LZ4E_IOV_BLOCK_SIZE has to match the block size of the library");
+
+/*
+ * Describe an iovec array as bvecs. The described size is capped at
+ * UINT_MAX, which is more than any block the library accepts.
+ * Returns the number of bvecs, or -E2BIG if there are too many of them.
+ */
+static int LZ4E_iov_to_bvecs(const struct iovec *iov, int iovCnt,
+			     struct bio_vec *bvecs, struct bvec_iter *iter)
+{
+	unsigned int size = 0;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < iovCnt && size < UINT_MAX; i++) {
+		const uintptr_t addr = (uintptr_t)iov[i].iov_base;
+		const size_t len = min_t(size_t, iov[i].iov_len,
+					 UINT_MAX - size);
+
+		if (!len)
+			continue;
+
+		if (count == LZ4E_SEG_MAX)
+			return -E2BIG;
+
+		bvecs[count].bv_page = (struct page *)(addr & PAGE_MASK);
+		bvecs[count].bv_offset = addr & ~PAGE_MASK;
+		bvecs[count].bv_len = (unsigned int)len;
+
+		size += (unsigned int)len;
+		count++;
+	}
+
+	*iter = (struct bvec_iter){ .bi_size = size };
+	return count;
+}
+
+int LZ4E_sizeofState(void)
+{
+	return LZ4E_MEM_COMPRESS;
+}
+
+int LZ4E_sizeofStateHC(void)
+{
+	return LZ4E_HC_MEM_COMPRESS;
+}
+
+int LZ4E_sizeofStreamDecode(void)
+{
+	return sizeof(LZ4E_streamDecode_t);
+}
+
+int LZ4E_compressBound(int inputSize)
+{
+	return LZ4E_COMPRESSBOUND(inputSize);
+}
+
+int LZ4E_blocksBound(int inputSize)
+{
+	return LZ4E_BLOCKS_BOUND(inputSize);
+}
+
+int LZ4E_compress_iov(const struct iovec *src, int srcCnt,
+		      const struct iovec *dst, int dstCnt, int acceleration,
+		      void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	return LZ4E_compress_fast(srcVecs, dstVecs, &srcIter, &dstIter,
+				  acceleration, state);
+}
+
+int LZ4E_compress_fast_xxh32_iov(const struct iovec *src, int srcCnt,
+				 const struct iovec *dst, int dstCnt,
+				 int acceleration, uint32_t *checksum,
+				 void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	return LZ4E_compress_fast_xxh32(srcVecs, dstVecs, &srcIter, &dstIter,
+					acceleration, checksum, state);
+}
+
+int LZ4E_compress_blocks_iov(const struct iovec *src, int srcCnt,
+			     const struct iovec *dst, int dstCnt,
+			     int acceleration, void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	return LZ4E_compress_blocks(srcVecs, dstVecs, &srcIter, &dstIter,
+				    acceleration, state);
+}
+
+int LZ4E_compress_HC_iov(const struct iovec *src, int srcCnt,
+			 const struct iovec *dst, int dstCnt,
+			 int compressionLevel, void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	return LZ4E_compress_HC(srcVecs, dstVecs, &srcIter, &dstIter,
+				compressionLevel, state);
+}
+
+int LZ4E_compress_destSize_iov(const struct iovec *src, int srcCnt,
+			       const struct iovec *dst, int dstCnt,
+			       int *srcSizePtr, void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	unsigned int srcSize;
+	int ret;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	srcSize = srcIter.bi_size;
+
+	ret = LZ4E_compress_destSize(srcVecs, dstVecs, &srcIter, &dstIter,
+				     state);
+	if (ret)
+		*srcSizePtr = (int)(srcSize - srcIter.bi_size);
+
+	return ret;
+}
+
+int LZ4E_compress_fast_continue_iov(const struct iovec *src, int srcCnt,
+				    const struct iovec *dst, int dstCnt,
+				    int acceleration, void *state)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+
+	if (LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter) < 0 ||
+	    LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter) < 0)
+		return 0;
+
+	return LZ4E_compress_fast_continue(state, srcVecs, dstVecs, &srcIter,
+					   &dstIter, acceleration);
+}
+
+int LZ4E_decompress_iov(const struct iovec *src, int srcCnt,
+			const struct iovec *dst, int dstCnt)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	ret = LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter);
+	if (ret < 0)
+		return ret;
+
+	ret = LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter);
+	if (ret < 0)
+		return ret;
+
+	return LZ4E_decompress_safe(srcVecs, dstVecs, &srcIter, &dstIter);
+}
+
+int LZ4E_decompress_safe_xxh32_iov(const struct iovec *src, int srcCnt,
+				   const struct iovec *dst, int dstCnt,
+				   const uint32_t *checksum)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	ret = LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter);
+	if (ret < 0)
+		return ret;
+
+	ret = LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter);
+	if (ret < 0)
+		return ret;
+
+	return LZ4E_decompress_safe_xxh32(srcVecs, dstVecs, &srcIter, &dstIter,
+					  checksum);
+}
+
+int LZ4E_decompress_blocks_iov(const struct iovec *src, int srcCnt,
+			       const struct iovec *dst, int dstCnt)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	ret = LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter);
+	if (ret < 0)
+		return ret;
+
+	ret = LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter);
+	if (ret < 0)
+		return ret;
+
+	return LZ4E_decompress_blocks(srcVecs, dstVecs, &srcIter, &dstIter);
+}
+
+int LZ4E_decompress_block_iov(const struct iovec *src, int srcCnt,
+			      const struct iovec *dst, int dstCnt,
+			      unsigned int blockIdx)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	ret = LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter);
+	if (ret < 0)
+		return ret;
+
+	ret = LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter);
+	if (ret < 0)
+		return ret;
+
+	return LZ4E_decompress_block(srcVecs, dstVecs, &srcIter, &dstIter,
+				     blockIdx);
+}
+
+int LZ4E_decompress_safe_continue_iov(const struct iovec *src, int srcCnt,
+				      const struct iovec *dst, int dstCnt,
+				      void *streamDecode)
+{
+	struct bio_vec srcVecs[LZ4E_SEG_MAX];
+	struct bio_vec dstVecs[LZ4E_SEG_MAX];
+	struct bvec_iter srcIter;
+	struct bvec_iter dstIter;
+	int ret;
+
+	ret = LZ4E_iov_to_bvecs(src, srcCnt, srcVecs, &srcIter);
+	if (ret < 0)
+		return ret;
+
+	ret = LZ4E_iov_to_bvecs(dst, dstCnt, dstVecs, &dstIter);
+	if (ret < 0)
+		return ret;
+
+	return LZ4E_decompress_safe_continue(streamDecode, srcVecs, dstVecs,
+					     &srcIter, &dstIter);
+}
@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * Userspace stand-ins for the kernel definitions used by the LZ4E sources.
+ * Every header under shim/linux includes this one, so the library files are
+ * compiled unchanged.
+ *
+ * Memory is not backed by real pages here: 'struct page' is a PAGE_SIZE
+ * chunk of the address space, and a page pointer is the address of the
+ * chunk itself. Any buffer can then be described by a bio_vec whose page
+ * is its address rounded down to PAGE_SIZE, and the bvec helpers split it
+ * into pages the same way the kernel does.
+ */
+
+#ifndef LZ4E_SHIM_H
+#define LZ4E_SHIM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*-************************************
+ *	Types
+ **************************************/
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+/*-************************************
+ *	Architecture
+ **************************************/
+#if __SIZEOF_LONG__ == 8
+#define CONFIG_64BIT 1
+#define BITS_PER_LONG 64
+#else
+#define BITS_PER_LONG 32
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define __LITTLE_ENDIAN 1234
+#else
+#define __BIG_ENDIAN 4321
+#endif
+
+/*-************************************
+ *	Compiler
+ **************************************/
+#undef __always_inline
+#define __always_inline inline __attribute__((__always_inline__))
+#define noinline __attribute__((__noinline__))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+
+static inline void lz4e_shim_bug(const char *file, int line)
+{
+	fprintf(stderr, "lz4e: BUG at %s:%d\n", file, line);
+	abort();
+}
+
+#define BUG_ON(cond)                                       \
+	do {                                               \
+		if (unlikely(cond))                        \
+			lz4e_shim_bug(__FILE__, __LINE__); \
+	} while (0)
+
+#define WARN_ON(cond) unlikely(cond)
+
+/*-************************************
+ *	Modules
+ **************************************/
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_AUTHOR(author)
+#define MODULE_DESCRIPTION(desc)
+#define MODULE_LICENSE(license)
+#define module_init(fn)
+#define module_exit(fn)
+#define __init
+#define __exit
+
+/*-************************************
+ *	Math and bit operations
+ **************************************/
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) min((type)(a), (type)(b))
+#define max_t(type, a, b) max((type)(a), (type)(b))
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define IS_ALIGNED(x, a) (((x) & ((typeof(x))(a) - 1)) == 0)
+
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+static inline unsigned long __fls(unsigned long word)
+{
+	return BITS_PER_LONG - 1 - __builtin_clzl(word);
+}
+
+static inline int fls(unsigned int x)
+{
+	return x ? 32 - __builtin_clz(x) : 0;
+}
+
+/*-************************************
+ *	Unaligned access
+ **************************************/
+/* A cast drops the qualifiers, so the copy is writable for const pointers */
+#define get_unaligned(ptr)                            \
+	({                                            \
+		typeof((typeof(*(ptr)))0) __val;      \
+		memcpy(&__val, (ptr), sizeof(__val)); \
+		__val;                                \
+	})
+
+#define put_unaligned(val, ptr)                       \
+	do {                                          \
+		typeof(*(ptr)) __val = (val);         \
+		memcpy((ptr), &__val, sizeof(__val)); \
+	} while (0)
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const u8 *b = p;
+
+	return (u16)(b[0] | b[1] << 8);
+}
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+	const u8 *b = p;
+
+	return (u32)b[0] | (u32)b[1] << 8 | (u32)b[2] << 16 | (u32)b[3] << 24;
+}
+
+static inline void put_unaligned_le16(u16 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = (u8)val;
+	b[1] = (u8)(val >> 8);
+}
+
+static inline void put_unaligned_le32(u32 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = (u8)val;
+	b[1] = (u8)(val >> 8);
+	b[2] = (u8)(val >> 16);
+	b[3] = (u8)(val >> 24);
+}
+
+/*-************************************
+ *	Pages
+ **************************************/
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+#define PAGE_MASK (~(PAGE_SIZE - 1))
+
+struct page {
+	char data[PAGE_SIZE];
+};
+
+#define nth_page(page, n) ((page) + (n))
+#define PageHighMem(page) false
+
+static inline void *page_address(const struct page *page)
+{
+	return (void *)page;
+}
+
+static inline void memcpy_from_page(char *to, struct page *page,
+				    size_t offset, size_t len)
+{
+	memcpy(to, (char *)page_address(page) + offset, len);
+}
+
+static inline void memcpy_to_page(struct page *page, size_t offset,
+				  const char *from, size_t len)
+{
+	memcpy((char *)page_address(page) + offset, from, len);
+}
+
+/*-************************************
+ *	Bio vectors
+ **************************************/
+#define BIO_MAX_VECS 256U
+
+struct bio_vec {
+	struct page *bv_page;
+	unsigned int bv_len;
+	unsigned int bv_offset;
+};
+
+struct bvec_iter {
+	u64 bi_sector;
+	unsigned int bi_size;
+	unsigned int bi_idx;
+	unsigned int bi_bvec_done;
+};
+
+/*
+ * The kernel defines these as macros, functions work the same way for every
+ * use in the library
+ */
+static inline const struct bio_vec *__bvec_iter_bvec(const struct bio_vec *bvec,
+						     struct bvec_iter iter)
+{
+	return &bvec[iter.bi_idx];
+}
+
+static inline unsigned int mp_bvec_iter_len(const struct bio_vec *bvec,
+					    struct bvec_iter iter)
+{
+	return min(iter.bi_size,
+		   __bvec_iter_bvec(bvec, iter)->bv_len - iter.bi_bvec_done);
+}
+
+static inline unsigned int mp_bvec_iter_offset(const struct bio_vec *bvec,
+					       struct bvec_iter iter)
+{
+	return __bvec_iter_bvec(bvec, iter)->bv_offset + iter.bi_bvec_done;
+}
+
+static inline struct bio_vec mp_bvec_iter_bvec(const struct bio_vec *bvec,
+					       struct bvec_iter iter)
+{
+	return (struct bio_vec){
+		.bv_page = __bvec_iter_bvec(bvec, iter)->bv_page,
+		.bv_len = mp_bvec_iter_len(bvec, iter),
+		.bv_offset = mp_bvec_iter_offset(bvec, iter),
+	};
+}
+
+static inline struct bio_vec bvec_iter_bvec(const struct bio_vec *bvec,
+					    struct bvec_iter iter)
+{
+	const unsigned int offset = mp_bvec_iter_offset(bvec, iter);
+	const unsigned int in_page = offset % PAGE_SIZE;
+
+	return (struct bio_vec){
+		.bv_page = nth_page(__bvec_iter_bvec(bvec, iter)->bv_page,
+				    offset / PAGE_SIZE),
+		.bv_len = min_t(unsigned int, mp_bvec_iter_len(bvec, iter),
+				PAGE_SIZE - in_page),
+		.bv_offset = in_page,
+	};
+}
+
+static inline bool bvec_iter_advance(const struct bio_vec *bv,
+				     struct bvec_iter *iter, unsigned int bytes)
+{
+	unsigned int idx = iter->bi_idx;
+
+	if (WARN_ON(bytes > iter->bi_size)) {
+		iter->bi_size = 0;
+		return false;
+	}
+
+	iter->bi_size -= bytes;
+	bytes += iter->bi_bvec_done;
+
+	while (bytes && bytes >= bv[idx].bv_len) {
+		bytes -= bv[idx].bv_len;
+		idx++;
+	}
+
+	iter->bi_idx = idx;
+	iter->bi_bvec_done = bytes;
+	return true;
+}
+
+static inline void bvec_iter_advance_single(const struct bio_vec *bv,
+					    struct bvec_iter *iter,
+					    unsigned int bytes)
+{
+	unsigned int done = iter->bi_bvec_done + bytes;
+
+	if (done == bv[iter->bi_idx].bv_len) {
+		done = 0;
+		iter->bi_idx++;
+	}
+
+	iter->bi_bvec_done = done;
+	iter->bi_size -= bytes;
+}
+
+/*-************************************
+ *	xxHash
+ **************************************/
+struct xxh32_state {
+	u32 total_len_32;
+	u32 large_len;
+	u32 v1;
+	u32 v2;
+	u32 v3;
+	u32 v4;
+	u32 mem32[4];
+	u32 memsize;
+};
+
+u32 xxh32(const void *input, size_t length, u32 seed);
+void xxh32_reset(struct xxh32_state *state, u32 seed);
+int xxh32_update(struct xxh32_state *state, const void *input, size_t length);
+u32 xxh32_digest(const struct xxh32_state *state);
+
+#endif
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+/*
+ * xxHash32 with the interface of the kernel's lib/xxhash.c, so that
+ * the checksumming functions of LZ4E can be built in userspace.
+ */
+
+#include "lz4e_shim.h"
+
+#define PRIME32_1 2654435761U
+#define PRIME32_2 2246822519U
+#define PRIME32_3 3266489917U
+#define PRIME32_4 668265263U
+#define PRIME32_5 374761393U
+
+static inline u32 xxh_rotl32(const u32 x, const int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static inline u32 xxh32_round(u32 seed, const u32 input)
+{
+	seed += input * PRIME32_2;
+	seed = xxh_rotl32(seed, 13);
+	seed *= PRIME32_1;
+	return seed;
+}
+
+static u32 xxh32_finalize(u32 h32, const u8 *p, const u8 *const b_end)
+{
+	while (p + 4 <= b_end) {
+		h32 += get_unaligned_le32(p) * PRIME32_3;
+		h32 = xxh_rotl32(h32, 17) * PRIME32_4;
+		p += 4;
+	}
+
+	while (p < b_end) {
+		h32 += (*p) * PRIME32_5;
+		h32 = xxh_rotl32(h32, 11) * PRIME32_1;
+		p++;
+	}
+
+	h32 ^= h32 >> 15;
+	h32 *= PRIME32_2;
+	h32 ^= h32 >> 13;
+	h32 *= PRIME32_3;
+	h32 ^= h32 >> 16;
+
+	return h32;
+}
+
+u32 xxh32(const void *input, const size_t len, const u32 seed)
+{
+	struct xxh32_state state;
+
+	xxh32_reset(&state, seed);
+	xxh32_update(&state, input, len);
+	return xxh32_digest(&state);
+}
+
+void xxh32_reset(struct xxh32_state *statePtr, const u32 seed)
+{
+	memset(statePtr, 0, sizeof(*statePtr));
+	statePtr->v1 = seed + PRIME32_1 + PRIME32_2;
+	statePtr->v2 = seed + PRIME32_2;
+	statePtr->v3 = seed + 0;
+	statePtr->v4 = seed - PRIME32_1;
+}
+
+int xxh32_update(struct xxh32_state *state, const void *input, const size_t len)
+{
+	const u8 *p = (const u8 *)input;
+	const u8 *const b_end = p + len;
+
+	if (input == NULL)
+		return -EINVAL;
+
+	state->total_len_32 += (u32)len;
+	state->large_len |= (len >= 16) | (state->total_len_32 >= 16);
+
+	if (state->memsize + len < 16) {
+		/* fill in tmp buffer */
+		memcpy((u8 *)(state->mem32) + state->memsize, input, len);
+		state->memsize += (u32)len;
+		return 0;
+	}
+
+	if (state->memsize) {
+		/* some data left from previous update */
+		const u32 *p32 = state->mem32;
+
+		memcpy((u8 *)(state->mem32) + state->memsize, input,
+		       16 - state->memsize);
+
+		state->v1 = xxh32_round(state->v1, get_unaligned_le32(p32++));
+		state->v2 = xxh32_round(state->v2, get_unaligned_le32(p32++));
+		state->v3 = xxh32_round(state->v3, get_unaligned_le32(p32++));
+		state->v4 = xxh32_round(state->v4, get_unaligned_le32(p32));
+
+		p += 16 - state->memsize;
+		state->memsize = 0;
+	}
+
+	if (p + 16 <= b_end) {
+		const u8 *const limit = b_end - 16;
+		u32 v1 = state->v1;
+		u32 v2 = state->v2;
+		u32 v3 = state->v3;
+		u32 v4 = state->v4;
+
+		do {
+			v1 = xxh32_round(v1, get_unaligned_le32(p));
+			p += 4;
+			v2 = xxh32_round(v2, get_unaligned_le32(p));
+			p += 4;
+			v3 = xxh32_round(v3, get_unaligned_le32(p));
+			p += 4;
+			v4 = xxh32_round(v4, get_unaligned_le32(p));
+			p += 4;
+		} while (p <= limit);
+
+		state->v1 = v1;
+		state->v2 = v2;
+		state->v3 = v3;
+		state->v4 = v4;
+	}
+
+	if (p < b_end) {
+		memcpy(state->mem32, p, (size_t)(b_end - p));
+		state->memsize = (u32)(b_end - p);
+	}
+
+	return 0;
+}
+
+u32 xxh32_digest(const struct xxh32_state *state)
+{
+	const u8 *p = (const u8 *)state->mem32;
+	const u8 *const b_end = (const u8 *)(state->mem32) + state->memsize;
+	u32 h32;
+
+	if (state->large_len) {
+		h32 = xxh_rotl32(state->v1, 1) + xxh_rotl32(state->v2, 7) +
+			xxh_rotl32(state->v3, 12) + xxh_rotl32(state->v4, 18);
+	} else {
+		h32 = state->v3 /* == seed */ + PRIME32_5;
+	}
+
+	h32 += state->total_len_32;
+
+	return xxh32_finalize(h32, p, b_end);
+}
@@ -0,0 +1,48 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+setup() {
+	make reinsert
+	modprobe brd rd_nr=1 rd_size="$DISK_SIZE_IN_KB" max_part=0
+	echo -n "$UNDERLYING_DEVICE" > "$DEVICE_MAPPER"
+	mkdir "$TEMP_DIR"
+}
+
+set_acceleration() {
+	echo -n "$1" > "$ACCELERATION"
+	[ "$(cat "$ACCELERATION")" = "$1" ]
+}
+
+reject_acceleration() {
+	! echo -n "$1" > "$ACCELERATION"
+}
+
+write_and_read() {
+	dd if="$PROXY_TEST_FILE2" of="$TEST_DEVICE" bs=4k count=5 oflag=direct
+	dd if="$TEST_DEVICE" of="$PROXY_OUTPUT_FILE2" bs=4k count=5 iflag=direct
+	cmp --verbose --bytes="$PROXY_TEST_FILE_LEN2" "$PROXY_TEST_FILE2" "$PROXY_OUTPUT_FILE2"
+}
+
+cleanup() {
+	exit_code=$?
+	rm -rf "$TEMP_DIR"
+	make remove
+	rmmod brd
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+set_acceleration 1
+write_and_read
+set_acceleration 8
+write_and_read
+set_acceleration 65537
+write_and_read
+reject_acceleration 0
+reject_acceleration 65538
+reject_acceleration fast
@@ -6,3 +6,10 @@ set -euxo pipefail
 ./test/bash_tests/test_info.sh
 ./test/bash_tests/test_proxy.sh
 ./test/bash_tests/test_stats.sh
+./test/bash_tests/test_acceleration.sh
+./test/bash_tests/test_hc_level.sh
+./test/bash_tests/test_probe_size.sh
+./test/bash_tests/test_dec_speed.sh
+./test/bash_tests/test_large_bio.sh
+./test/bash_tests/test_same_filled.sh
+./test/bash_tests/test_bench.sh
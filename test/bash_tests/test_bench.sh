@@ -0,0 +1,49 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+# Layouts times corpora, plus two header lines
+TABLE_LINES=18
+
+setup() {
+	make reinsert
+}
+
+set_parameter() {
+	echo -n "$2" > "$1"
+	[ "$(cat "$1")" = "$2" ]
+}
+
+reject_parameter() {
+	! echo -n "$2" > "$1"
+}
+
+run_bench() {
+	echo -n 1 > "$BENCH_RUN"
+	cat "$BENCH_RUN"
+	[ "$(wc -l < "$BENCH_RUN")" -eq "$TABLE_LINES" ]
+	grep --quiet "input: $1 bytes" "$BENCH_RUN"
+}
+
+cleanup() {
+	exit_code=$?
+	make remove
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+! cat "$BENCH_RUN"
+set_parameter "$BENCH_ITERATIONS" 10
+run_bench 65536
+set_parameter "$BENCH_SIZE" 4096
+run_bench 4096
+set_parameter "$BENCH_SIZE" 1000
+run_bench 1000
+reject_parameter "$BENCH_SIZE" 0
+reject_parameter "$BENCH_SIZE" 65537
+reject_parameter "$BENCH_ITERATIONS" 0
+reject_parameter "$BENCH_ITERATIONS" many
@@ -0,0 +1,50 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+setup() {
+	make reinsert
+	modprobe brd rd_nr=1 rd_size="$DISK_SIZE_IN_KB" max_part=0
+	echo -n "$UNDERLYING_DEVICE" > "$DEVICE_MAPPER"
+	mkdir "$TEMP_DIR"
+}
+
+set_hc_level() {
+	echo -n "$1" > "$HC_LEVEL"
+	[ "$(cat "$HC_LEVEL")" = "$1" ]
+}
+
+reject_hc_level() {
+	! echo -n "$1" > "$HC_LEVEL"
+}
+
+write_and_read() {
+	dd if="$PROXY_TEST_FILE2" of="$TEST_DEVICE" bs=4k count=5 oflag=direct
+	dd if="$TEST_DEVICE" of="$PROXY_OUTPUT_FILE2" bs=4k count=5 iflag=direct
+	cmp --verbose --bytes="$PROXY_TEST_FILE_LEN2" "$PROXY_TEST_FILE2" "$PROXY_OUTPUT_FILE2"
+}
+
+cleanup() {
+	exit_code=$?
+	rm -rf "$TEMP_DIR"
+	make remove
+	rmmod brd
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+set_hc_level 3
+write_and_read
+set_hc_level 9
+write_and_read
+set_hc_level 16
+write_and_read
+set_hc_level 0
+write_and_read
+reject_hc_level 1
+reject_hc_level 17
+reject_hc_level high
@@ -0,0 +1,65 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+setup() {
+	make reinsert
+	modprobe brd rd_nr=1 rd_size="$DISK_SIZE_IN_KB" max_part=0
+	echo -n "$UNDERLYING_DEVICE" > "$DEVICE_MAPPER"
+	mkdir "$TEMP_DIR"
+	make_large_file
+}
+
+# Text, zeros, a jpg and random data in turns, so that compressible and
+# incompressible blocks alternate within every bio
+make_large_file() {
+	touch "$LARGE_TEST_FILE"
+	while [ "$(stat --print="%s" "$LARGE_TEST_FILE")" -lt "$LARGE_TEST_FILE_LEN" ]; do
+		for _ in {1..8}; do
+			cat "$PROXY_TEST_FILE2" >> "$LARGE_TEST_FILE"
+		done
+		head --bytes=64k "$DEVICE_ZERO" >> "$LARGE_TEST_FILE"
+		cat "$PROXY_TEST_FILE3" >> "$LARGE_TEST_FILE"
+		head --bytes=32k "$DEVICE_RANDOM" >> "$LARGE_TEST_FILE"
+	done
+	truncate --size="$LARGE_TEST_FILE_LEN" "$LARGE_TEST_FILE"
+}
+
+set_dec_speed() {
+	echo -n "$1" > "$DEC_SPEED"
+	[ "$(cat "$DEC_SPEED")" = "$1" ]
+}
+
+set_hc_level() {
+	echo -n "$1" > "$HC_LEVEL"
+	[ "$(cat "$HC_LEVEL")" = "$1" ]
+}
+
+# Bios of 1MB are compressed in parallel blocks and read back block by block
+write_and_read() {
+	dd if="$LARGE_TEST_FILE" of="$TEST_DEVICE" bs=1M count="$LARGE_TEST_FILE_MB" oflag=direct
+	dd if="$TEST_DEVICE" of="$LARGE_OUTPUT_FILE" bs=1M count="$LARGE_TEST_FILE_MB" iflag=direct
+	cmp --verbose --bytes="$LARGE_TEST_FILE_LEN" "$LARGE_TEST_FILE" "$LARGE_OUTPUT_FILE"
+	rm "$LARGE_OUTPUT_FILE"
+}
+
+cleanup() {
+	exit_code=$?
+	rm -rf "$TEMP_DIR"
+	make remove
+	rmmod brd
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+for hc_level in 0 9; do
+	for dec_speed in 0 1; do
+		set_hc_level "$hc_level"
+		set_dec_speed "$dec_speed"
+		write_and_read
+	done
+done
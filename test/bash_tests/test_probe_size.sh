@@ -0,0 +1,84 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+setup() {
+	make reinsert
+	modprobe brd rd_nr=1 rd_size="$DISK_SIZE_IN_KB" max_part=0
+	echo -n "$UNDERLYING_DEVICE" > "$DEVICE_MAPPER"
+	mkdir "$TEMP_DIR"
+	make_large_jpg_file
+}
+
+# The jpg repeated up to 1MB, so that a single bio is compressed in parallel
+make_large_jpg_file() {
+	touch "$LARGE_JPG_FILE"
+	while [ "$(stat --print="%s" "$LARGE_JPG_FILE")" -lt "$LARGE_JPG_FILE_LEN" ]; do
+		cat "$PROXY_TEST_FILE3" >> "$LARGE_JPG_FILE"
+	done
+	truncate --size="$LARGE_JPG_FILE_LEN" "$LARGE_JPG_FILE"
+}
+
+set_hc_level() {
+	echo -n "$1" > "$HC_LEVEL"
+	[ "$(cat "$HC_LEVEL")" = "$1" ]
+}
+
+set_probe_size() {
+	echo -n "$1" > "$PROBE_SIZE"
+	[ "$(cat "$PROBE_SIZE")" = "$1" ]
+}
+
+reject_probe_size() {
+	! echo -n "$1" > "$PROBE_SIZE"
+}
+
+write_and_read() {
+	dd if="$PROXY_TEST_FILE2" of="$TEST_DEVICE" bs=4k count=5 oflag=direct
+	dd if="$TEST_DEVICE" of="$PROXY_OUTPUT_FILE2" bs=4k count=5 iflag=direct
+	cmp --verbose --bytes="$PROXY_TEST_FILE_LEN2" "$PROXY_TEST_FILE2" "$PROXY_OUTPUT_FILE2"
+}
+
+write_and_read_incompressible() {
+	dd if="$PROXY_TEST_FILE3" of="$TEST_DEVICE" bs=36k count=8 oflag=direct
+	dd if="$TEST_DEVICE" of="$PROXY_OUTPUT_FILE3" bs=36k count=8 iflag=direct
+	cmp --verbose --bytes="$PROXY_TEST_FILE_LEN3" "$PROXY_TEST_FILE3" "$PROXY_OUTPUT_FILE3"
+}
+
+# The whole bio is expected to be stored as is, which is only seen in logs
+write_and_read_large_incompressible() {
+	dmesg --clear
+	dd if="$LARGE_JPG_FILE" of="$TEST_DEVICE" bs=1M count="$LARGE_JPG_FILE_MB" oflag=direct
+	dmesg | grep "$BDEV_NAME: data is incompressible" > /dev/null
+	dd if="$TEST_DEVICE" of="$LARGE_JPG_OUTPUT_FILE" bs=1M count="$LARGE_JPG_FILE_MB" iflag=direct
+	cmp --verbose --bytes="$LARGE_JPG_FILE_LEN" "$LARGE_JPG_FILE" "$LARGE_JPG_OUTPUT_FILE"
+}
+
+cleanup() {
+	exit_code=$?
+	rm -rf "$TEMP_DIR"
+	make remove
+	rmmod brd
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+set_probe_size 1024
+write_and_read
+write_and_read_incompressible
+write_and_read_large_incompressible
+set_hc_level 9
+write_and_read_large_incompressible
+set_hc_level 0
+set_probe_size 16
+write_and_read
+write_and_read_incompressible
+set_probe_size 0
+write_and_read
+write_and_read_incompressible
+reject_probe_size -1
+reject_probe_size small
@@ -0,0 +1,56 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+SAME_FILLED_FILE=$TEMP_DIR/same_filled
+SAME_FILLED_OUTPUT_FILE=$TEMP_DIR/same_filled_output
+
+setup() {
+	make reinsert
+	modprobe brd rd_nr=1 rd_size="$DISK_SIZE_IN_KB" max_part=0
+	echo -n "$UNDERLYING_DEVICE" > "$DEVICE_MAPPER"
+	mkdir "$TEMP_DIR"
+}
+
+write_and_read() {
+	bs=$1
+	count=$2
+
+	dd if="$SAME_FILLED_FILE" of="$TEST_DEVICE" bs="$bs" count="$count" oflag=direct
+	dd if="$TEST_DEVICE" of="$SAME_FILLED_OUTPUT_FILE" bs="$bs" count="$count" iflag=direct
+	cmp --verbose "$SAME_FILLED_FILE" "$SAME_FILLED_OUTPUT_FILE"
+}
+
+test_zero() {
+	dd if="$DEVICE_ZERO" of="$SAME_FILLED_FILE" bs=4k count=16
+	write_and_read 4k 16
+	write_and_read 64k 1
+}
+
+test_pattern() {
+	yes "lz4e_bdev" | tr -d '\n' | head -c 65536 > "$SAME_FILLED_FILE" || true
+	write_and_read 4k 16
+
+	printf 'same fil' > "$SAME_FILLED_FILE"
+	for _ in $(seq 13); do
+		cat "$SAME_FILLED_FILE" "$SAME_FILLED_FILE" > "$SAME_FILLED_OUTPUT_FILE"
+		mv "$SAME_FILLED_OUTPUT_FILE" "$SAME_FILLED_FILE"
+	done
+	write_and_read 4k 16
+}
+
+cleanup() {
+	exit_code=$?
+	rm -rf "$TEMP_DIR"
+	make remove
+	rmmod brd
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+setup
+test_zero
+test_pattern
@@ -0,0 +1,18 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+cleanup() {
+	exit_code=$?
+	rmmod "$KUNIT_NAME" || true
+	exit $exit_code
+}
+
+trap cleanup EXIT
+
+# The suite runs as soon as the module is inserted
+insmod "$KUNIT_MODULE"
+cat "$KUNIT_RESULTS"
+! grep --quiet "not ok" "$KUNIT_RESULTS"
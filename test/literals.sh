@@ -4,6 +4,10 @@ export BDEV_PARAMETERS=/sys/module/$BDEV_NAME/parameters
 export DEVICE_MAPPER=$BDEV_PARAMETERS/mapper
 export DEVICE_UNMAPPER=$BDEV_PARAMETERS/unmapper
 export REQUEST_STATS=$BDEV_PARAMETERS/stats
+export ACCELERATION=$BDEV_PARAMETERS/acceleration
+export HC_LEVEL=$BDEV_PARAMETERS/hc_level
+export PROBE_SIZE=$BDEV_PARAMETERS/probe_size
+export DEC_SPEED=$BDEV_PARAMETERS/dec_speed
 
 export UNDERLYING_DEVICE=/dev/ram0
 export TEST_DEVICE=/dev/lz4e0
@@ -24,5 +28,31 @@ export PROXY_OUTPUT_FILE1=$TEMP_DIR/01.txt
 export PROXY_OUTPUT_FILE2=$TEMP_DIR/02.txt
 export PROXY_OUTPUT_FILE3=$TEMP_DIR/03.jpg
 
+export LARGE_TEST_FILE_MB=4
+export LARGE_TEST_FILE_LEN=$((LARGE_TEST_FILE_MB * 1024 * 1024))
+export LARGE_TEST_FILE=$TEMP_DIR/large.bin
+export LARGE_OUTPUT_FILE=$TEMP_DIR/large.out
+
+export LARGE_JPG_FILE_MB=1
+export LARGE_JPG_FILE_LEN=$((LARGE_JPG_FILE_MB * 1024 * 1024))
+export LARGE_JPG_FILE=$TEMP_DIR/large.jpg
+export LARGE_JPG_OUTPUT_FILE=$TEMP_DIR/large_jpg.out
+
 export DEVICE_ZERO=/dev/zero
 export DEVICE_RANDOM=/dev/random
+
+export USER_LIB_DIR=build/lz4e_user
+export USER_LIB_INCLUDE=lz4e_user/include
+export USER_TEST_IOV=$USER_LIB_DIR/test_iov
+export USER_BENCH_SPECIALIZED=$USER_LIB_DIR/bench_specialized
+export USER_BENCH_GENERIC=$USER_LIB_DIR/bench_generic
+
+export BENCH_NAME=lz4e_bench
+export BENCH_PARAMETERS=/sys/module/$BENCH_NAME/parameters
+export BENCH_SIZE=$BENCH_PARAMETERS/size
+export BENCH_ITERATIONS=$BENCH_PARAMETERS/iterations
+export BENCH_RUN=$BENCH_PARAMETERS/run
+
+export KUNIT_NAME=lz4e_defs_kunit
+export KUNIT_MODULE=build/lz4e/$KUNIT_NAME.ko
+export KUNIT_RESULTS=/sys/kernel/debug/kunit/lz4e_defs/results
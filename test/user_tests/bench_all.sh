@@ -0,0 +1,18 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+make user
+make -C lz4e_user generic
+
+cc -Wall -Werror -std=gnu18 -g -O2 -I"$USER_LIB_INCLUDE" \
+	test/user_tests/bench_dispatch.c "$USER_LIB_DIR/liblz4e.a" \
+	-o "$USER_BENCH_SPECIALIZED"
+cc -Wall -Werror -std=gnu18 -g -O2 -I"$USER_LIB_INCLUDE" \
+	test/user_tests/bench_dispatch.c "$USER_LIB_DIR/liblz4e_generic.a" \
+	-o "$USER_BENCH_GENERIC"
+
+"$USER_BENCH_SPECIALIZED" specialized
+"$USER_BENCH_GENERIC" generic
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+// Compression speed of liblz4e for every (table type, output limit) instance
+// of the compressor. Linked once against the regular library and once
+// against the one built with LZ4E_BENCH_GENERIC, where a single out-of-line
+// body takes the table type and the output limit at runtime, it shows what
+// the specialized instances gain. Process CPU time is measured, the best of
+// RUNS runs is taken.
+
+#include "lz4e_iov.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define PAGE 4096
+#define RUNS 15
+#define BYTES_PER_RUN (4 << 20)
+
+enum corpus {
+	CORPUS_TEXT,
+	CORPUS_RANDOM,
+	CORPUS_MIXED,
+	CORPUS_COUNT,
+};
+
+static const char *const corpus_names[] = { "text", "random", "mixed" };
+
+static const char words[] =
+	"the quick brown fox jumps over the lazy dog while lz4e "
+	"compresses scattered buffers without gathering them first ";
+
+// Inputs of a single page, below 64KB and above it take the byU16Page,
+// byU16 and byU32 tables
+static const struct {
+	const char *table;
+	size_t len;
+} cases[] = {
+	{ "byU16Page", PAGE },
+	{ "byU16", 8 * PAGE },
+	{ "byU32", 64 * PAGE },
+};
+
+static void fill(unsigned char *buf, size_t len, enum corpus corpus)
+{
+	for (size_t i = 0; i < len; i++) {
+		switch (corpus) {
+		case CORPUS_TEXT:
+			buf[i] = words[(i * 7 + i / 61) % (sizeof(words) - 1)];
+			break;
+		case CORPUS_RANDOM:
+			buf[i] = (unsigned char)rand();
+			break;
+		default:
+			buf[i] = (i / PAGE) % 2 ?
+					 (unsigned char)rand() :
+					 words[i % (sizeof(words) - 1)];
+			break;
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Best speed in MB/s of compressing the pages of buf into a buffer of
+// dst_len bytes, or a negative value if the compression fails
+static double bench(unsigned char *buf, size_t len, unsigned char *dst,
+		    size_t dst_len, void *state)
+{
+	const int iters = BYTES_PER_RUN / len;
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec dst_iov = { .iov_base = dst, .iov_len = dst_len };
+	const int cnt = (int)(len / PAGE);
+	double best = 0;
+
+	// Every page is its own entry, as in a bio
+	for (int i = 0; i < cnt; i++) {
+		src_iov[i].iov_base = buf + i * PAGE;
+		src_iov[i].iov_len = PAGE;
+	}
+
+	for (int r = 0; r < RUNS; r++) {
+		const double start = now();
+		double speed;
+
+		for (int i = 0; i < iters; i++) {
+			if (LZ4E_compress_iov(src_iov, cnt, &dst_iov, 1, 1,
+					      state) <= 0)
+				return -1;
+		}
+
+		speed = (double)len * iters / (now() - start) / 1e6;
+		if (speed > best)
+			best = speed;
+	}
+
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = argc > 1 ? argv[1] : "";
+	const int n_cases = sizeof(cases) / sizeof(cases[0]);
+	const size_t max_len = cases[n_cases - 1].len;
+	const size_t bound = (size_t)LZ4E_compressBound((int)max_len);
+	unsigned char *buf = aligned_alloc(PAGE, max_len);
+	unsigned char *dst = malloc(bound);
+	void *state = calloc(1, LZ4E_sizeofState());
+	int ret = EXIT_FAILURE;
+
+	if (!buf || !dst || !state)
+		goto out;
+
+	srand(0);
+
+	printf("%-12s %-10s %-7s %12s %12s\n", name, "table", "corpus",
+	       "noLimit MB/s", "limited MB/s");
+
+	for (int c = 0; c < n_cases; c++) {
+		for (int corpus = 0; corpus < CORPUS_COUNT; corpus++) {
+			const size_t len = cases[c].len;
+			const size_t len_bound =
+				(size_t)LZ4E_compressBound((int)len);
+			double unlimited;
+			double limited;
+
+			fill(buf, len, corpus);
+
+			// A byte below the bound already limits the output,
+			// and still fits random data stored as literals
+			unlimited = bench(buf, len, dst, len_bound, state);
+			limited = bench(buf, len, dst, len_bound - 1, state);
+
+			if (unlimited < 0 || limited < 0) {
+				fprintf(stderr, "compression failed\n");
+				goto out;
+			}
+
+			printf("%-12s %-10s %-7s %12.0f %12.0f\n", name,
+			       cases[c].table, corpus_names[corpus], unlimited,
+			       limited);
+		}
+	}
+
+	ret = EXIT_SUCCESS;
+
+out:
+	free(buf);
+	free(dst);
+	free(state);
+	return ret;
+}
@@ -0,0 +1,11 @@
+#! /bin/bash
+
+source test/literals.sh
+
+set -euxo pipefail
+
+make user
+
+cc -Wall -Werror -std=gnu18 -g -O2 -I"$USER_LIB_INCLUDE" \
+	test/user_tests/test_iov.c "$USER_LIB_DIR/liblz4e.a" -o "$USER_TEST_IOV"
+"$USER_TEST_IOV"
@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2025 Alexander Bugaev
+ *
+ * This file is released under the GPL.
+ */
+
+// Round trip of liblz4e over scattered buffers: the input is compressed from
+// and decompressed into iovecs of various layouts and compared with the
+// original.
+
+#include "lz4e_iov.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#define GAP_MAX 64
+
+enum corpus {
+	CORPUS_TEXT,
+	CORPUS_ZEROS,
+	CORPUS_RANDOM,
+	CORPUS_MIXED,
+	CORPUS_COUNT,
+};
+
+static const char *const corpus_names[] = { "text", "zeros", "random",
+					    "mixed" };
+
+static const char words[] =
+	"the quick brown fox jumps over the lazy dog while lz4e "
+	"compresses scattered buffers without gathering them first ";
+
+static void fill(unsigned char *buf, size_t len, enum corpus corpus)
+{
+	for (size_t i = 0; i < len; i++) {
+		switch (corpus) {
+		case CORPUS_TEXT:
+			buf[i] = words[(i * 7 + i / 61) % (sizeof(words) - 1)];
+			break;
+		case CORPUS_ZEROS:
+			buf[i] = 0;
+			break;
+		case CORPUS_RANDOM:
+			buf[i] = (unsigned char)rand();
+			break;
+		default:
+			buf[i] = (i / 4096) % 2 ?
+					 (unsigned char)rand() :
+					 words[i % (sizeof(words) - 1)];
+			break;
+		}
+	}
+}
+
+// Split len bytes of buf into count entries of random lengths, some of them
+// empty, leaving gaps so that no entries are adjacent in memory
+static void scatter(unsigned char *buf, size_t len, struct iovec *iov,
+		    int count)
+{
+	size_t off = 0;
+
+	for (int i = 0; i < count; i++) {
+		size_t part = rand() % (2 * len / count + 1);
+
+		if (i == count - 1 || part > len)
+			part = len;
+
+		iov[i].iov_base = buf + off;
+		iov[i].iov_len = part;
+
+		off += part + rand() % GAP_MAX;
+		len -= part;
+	}
+}
+
+static size_t gather(unsigned char *buf, const struct iovec *iov, int count)
+{
+	size_t off = 0;
+
+	for (int i = 0; i < count; i++) {
+		memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+		off += iov[i].iov_len;
+	}
+
+	return off;
+}
+
+// Cut the entries down to the first len bytes they describe
+static void truncate_iov(struct iovec *iov, int count, size_t len)
+{
+	for (int i = 0; i < count; i++) {
+		if (iov[i].iov_len > len)
+			iov[i].iov_len = len;
+
+		len -= iov[i].iov_len;
+	}
+}
+
+static int round_trip(enum corpus corpus, size_t len, int src_cnt,
+		      int dst_cnt, int hc)
+{
+	const size_t bound = (size_t)LZ4E_compressBound((int)len);
+	const int state_size = hc ? LZ4E_sizeofStateHC() : LZ4E_sizeofState();
+	unsigned char *input = malloc(len);
+	unsigned char *output = malloc(len);
+	unsigned char *src_buf = malloc(len + src_cnt * GAP_MAX);
+	unsigned char *cmp_buf = malloc(bound + dst_cnt * GAP_MAX);
+	unsigned char *dec_buf = malloc(len + src_cnt * GAP_MAX);
+	void *state = calloc(1, state_size);
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec cmp_iov[LZ4E_IOV_MAX];
+	struct iovec dec_iov[LZ4E_IOV_MAX];
+	int cmp_size;
+	int dec_size;
+	int ret = 1;
+
+	if (!input || !output || !src_buf || !cmp_buf || !dec_buf || !state)
+		goto out;
+
+	fill(input, len, corpus);
+	scatter(src_buf, len, src_iov, src_cnt);
+	scatter(cmp_buf, bound, cmp_iov, dst_cnt);
+	scatter(dec_buf, len, dec_iov, src_cnt);
+
+	for (int i = 0, off = 0; i < src_cnt; off += src_iov[i++].iov_len)
+		memcpy(src_iov[i].iov_base, input + off, src_iov[i].iov_len);
+
+	if (hc)
+		cmp_size = LZ4E_compress_HC_iov(src_iov, src_cnt, cmp_iov,
+						dst_cnt, 0, state);
+	else
+		cmp_size = LZ4E_compress_iov(src_iov, src_cnt, cmp_iov, dst_cnt,
+					     1, state);
+
+	if (cmp_size <= 0) {
+		fprintf(stderr, "compression failed: %d\n", cmp_size);
+		goto out;
+	}
+
+	// Only the written part of the buffers makes up the block
+	truncate_iov(cmp_iov, dst_cnt, (size_t)cmp_size);
+
+	dec_size = LZ4E_decompress_iov(cmp_iov, dst_cnt, dec_iov, src_cnt);
+	if (dec_size != (int)len) {
+		fprintf(stderr, "decompression failed: %d\n", dec_size);
+		goto out;
+	}
+
+	if (gather(output, dec_iov, src_cnt) != len ||
+	    memcmp(input, output, len)) {
+		fprintf(stderr, "data mismatch\n");
+		goto out;
+	}
+
+	printf("%-6s %7zu bytes, %3d -> %3d iovecs%s: %d bytes\n",
+	       corpus_names[corpus], len, src_cnt, dst_cnt, hc ? ", HC" : "",
+	       cmp_size);
+	ret = 0;
+
+out:
+	free(input);
+	free(output);
+	free(src_buf);
+	free(cmp_buf);
+	free(dec_buf);
+	free(state);
+	return ret;
+}
+
+// Compress as much of the input as fits into target bytes, then check that
+// the output is filled and decompresses into the consumed part of the input
+static int dest_size(enum corpus corpus, size_t len, int cnt, size_t target)
+{
+	unsigned char *input = malloc(len);
+	unsigned char *output = malloc(len);
+	unsigned char *src_buf = malloc(len + cnt * GAP_MAX);
+	unsigned char *cmp_buf = malloc(target + cnt * GAP_MAX);
+	unsigned char *dec_buf = malloc(len + cnt * GAP_MAX);
+	void *state = calloc(1, LZ4E_sizeofState());
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec cmp_iov[LZ4E_IOV_MAX];
+	struct iovec dec_iov[LZ4E_IOV_MAX];
+	int src_size = -1;
+	int cmp_size;
+	int dec_size;
+	int ret = 1;
+
+	if (!input || !output || !src_buf || !cmp_buf || !dec_buf || !state)
+		goto out;
+
+	fill(input, len, corpus);
+	scatter(src_buf, len, src_iov, cnt);
+	scatter(cmp_buf, target, cmp_iov, cnt);
+
+	for (int i = 0, off = 0; i < cnt; off += src_iov[i++].iov_len)
+		memcpy(src_iov[i].iov_base, input + off, src_iov[i].iov_len);
+
+	cmp_size = LZ4E_compress_destSize_iov(src_iov, cnt, cmp_iov, cnt,
+					      &src_size, state);
+	if (cmp_size <= 0 || (size_t)cmp_size > target || src_size < 0 ||
+	    (size_t)src_size > len) {
+		fprintf(stderr, "compression failed: %d, consumed %d\n",
+			cmp_size, src_size);
+		goto out;
+	}
+
+	// Only a length byte may be left over, unless the input ran out
+	if ((size_t)src_size < len && (size_t)cmp_size + 1 < target) {
+		fprintf(stderr, "output not filled: %d of %zu bytes\n",
+			cmp_size, target);
+		goto out;
+	}
+
+	truncate_iov(cmp_iov, cnt, (size_t)cmp_size);
+	scatter(dec_buf, (size_t)src_size, dec_iov, cnt);
+
+	dec_size = LZ4E_decompress_iov(cmp_iov, cnt, dec_iov, cnt);
+	if (dec_size != src_size) {
+		fprintf(stderr, "decompression failed: %d\n", dec_size);
+		goto out;
+	}
+
+	if (gather(output, dec_iov, cnt) != (size_t)src_size ||
+	    memcmp(input, output, (size_t)src_size)) {
+		fprintf(stderr, "data mismatch\n");
+		goto out;
+	}
+
+	printf("%-6s %7zu bytes, %3d iovecs, into %5zu: %d bytes from %d\n",
+	       corpus_names[corpus], len, cnt, target, cmp_size, src_size);
+	ret = 0;
+
+out:
+	free(input);
+	free(output);
+	free(src_buf);
+	free(cmp_buf);
+	free(dec_buf);
+	free(state);
+	return ret;
+}
+
+// Compress the input as independent blocks, decompress all of them and every
+// one alone, then check that damaged frames are rejected
+static int blocks(enum corpus corpus, size_t len, int cnt)
+{
+	const size_t bound = (size_t)LZ4E_blocksBound((int)len);
+	const unsigned int n_blocks =
+		(len + LZ4E_IOV_BLOCK_SIZE - 1) / LZ4E_IOV_BLOCK_SIZE;
+	const size_t index_len = 4 + 4 * n_blocks;
+	unsigned char *input = malloc(len);
+	unsigned char *output = malloc(len);
+	unsigned char *src_buf = malloc(len + cnt * GAP_MAX);
+	unsigned char *cmp_buf = malloc(bound + cnt * GAP_MAX);
+	unsigned char *frame = malloc(bound);
+	unsigned char *dec_buf = malloc(len + cnt * GAP_MAX);
+	void *state = calloc(1, LZ4E_sizeofState());
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec cmp_iov[LZ4E_IOV_MAX];
+	struct iovec dec_iov[LZ4E_IOV_MAX];
+	struct iovec frame_iov;
+	struct iovec out_iov = { .iov_base = output, .iov_len = len };
+	int cmp_size;
+	int dec_size;
+	int ret = 1;
+
+	if (!input || !output || !src_buf || !cmp_buf || !frame || !dec_buf ||
+	    !state)
+		goto out;
+
+	fill(input, len, corpus);
+	scatter(src_buf, len, src_iov, cnt);
+	scatter(cmp_buf, bound, cmp_iov, cnt);
+	scatter(dec_buf, len, dec_iov, cnt);
+
+	for (int i = 0, off = 0; i < cnt; off += src_iov[i++].iov_len)
+		memcpy(src_iov[i].iov_base, input + off, src_iov[i].iov_len);
+
+	cmp_size = LZ4E_compress_blocks_iov(src_iov, cnt, cmp_iov, cnt, 1,
+					    state);
+	if (cmp_size <= 0) {
+		fprintf(stderr, "compression failed: %d\n", cmp_size);
+		goto out;
+	}
+
+	truncate_iov(cmp_iov, cnt, (size_t)cmp_size);
+
+	dec_size = LZ4E_decompress_blocks_iov(cmp_iov, cnt, dec_iov, cnt);
+	if (dec_size != (int)len || gather(output, dec_iov, cnt) != len ||
+	    memcmp(input, output, len)) {
+		fprintf(stderr, "decompression failed: %d\n", dec_size);
+		goto out;
+	}
+
+	// Random access, every block is decoded into the front of 'output'
+	for (unsigned int b = 0; b < n_blocks; b++) {
+		const size_t off = (size_t)b * LZ4E_IOV_BLOCK_SIZE;
+		const size_t block_len = len - off < LZ4E_IOV_BLOCK_SIZE ?
+						 len - off :
+						 LZ4E_IOV_BLOCK_SIZE;
+
+		memset(output, 0, len);
+		dec_size = LZ4E_decompress_block_iov(cmp_iov, cnt, &out_iov, 1,
+						     b);
+		if (dec_size != (int)block_len ||
+		    memcmp(input + off, output, block_len)) {
+			fprintf(stderr, "block %u failed: %d\n", b, dec_size);
+			goto out;
+		}
+	}
+
+	if (LZ4E_decompress_block_iov(cmp_iov, cnt, &out_iov, 1, n_blocks) >=
+	    0) {
+		fprintf(stderr, "block out of range accepted\n");
+		goto out;
+	}
+
+	// Damaged frames are checked flat, the index may cross the entries
+	gather(frame, cmp_iov, cnt);
+	frame_iov.iov_base = frame;
+
+	// Index cut short
+	frame_iov.iov_len = index_len - 1;
+	if (LZ4E_decompress_blocks_iov(&frame_iov, 1, &out_iov, 1) >= 0 ||
+	    LZ4E_decompress_block_iov(&frame_iov, 1, &out_iov, 1, 0) >= 0) {
+		fprintf(stderr, "truncated index accepted\n");
+		goto out;
+	}
+
+	// Last block cut short
+	frame_iov.iov_len = (size_t)cmp_size - 1;
+	if (LZ4E_decompress_blocks_iov(&frame_iov, 1, &out_iov, 1) >= 0 ||
+	    LZ4E_decompress_block_iov(&frame_iov, 1, &out_iov, 1,
+				      n_blocks - 1) >= 0) {
+		fprintf(stderr, "truncated block accepted\n");
+		goto out;
+	}
+
+	// First block claims a trailing byte of the next one
+	frame_iov.iov_len = (size_t)cmp_size;
+	frame[4]++;
+	if (LZ4E_decompress_blocks_iov(&frame_iov, 1, &out_iov, 1) >= 0 ||
+	    LZ4E_decompress_block_iov(&frame_iov, 1, &out_iov, 1, 0) >= 0) {
+		fprintf(stderr, "corrupt block size accepted\n");
+		goto out;
+	}
+	frame[4]--;
+
+	// Input size that does not match the blocks
+	frame[0]--;
+	if (LZ4E_decompress_blocks_iov(&frame_iov, 1, &out_iov, 1) >= 0) {
+		fprintf(stderr, "corrupt input size accepted\n");
+		goto out;
+	}
+	frame[0]++;
+
+	printf("%-6s %7zu bytes, %3d iovecs, %2u blocks: %d bytes\n",
+	       corpus_names[corpus], len, cnt, n_blocks, cmp_size);
+	ret = 0;
+
+out:
+	free(input);
+	free(output);
+	free(src_buf);
+	free(cmp_buf);
+	free(frame);
+	free(dec_buf);
+	free(state);
+	return ret;
+}
+
+// Compress with a checksum of the input, which has to match the decompressed
+// data, and check that any other checksum is rejected
+static int checksum(enum corpus corpus, size_t len, int cnt)
+{
+	const size_t bound = (size_t)LZ4E_compressBound((int)len);
+	unsigned char *input = malloc(len);
+	unsigned char *output = malloc(len);
+	unsigned char *src_buf = malloc(len + cnt * GAP_MAX);
+	unsigned char *cmp_buf = malloc(bound + cnt * GAP_MAX);
+	unsigned char *dec_buf = malloc(len + cnt * GAP_MAX);
+	void *state = calloc(1, LZ4E_sizeofState());
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec cmp_iov[LZ4E_IOV_MAX];
+	struct iovec dec_iov[LZ4E_IOV_MAX];
+	uint32_t sum = 0;
+	uint32_t bad_sum;
+	int cmp_size;
+	int dec_size;
+	int ret = 1;
+
+	if (!input || !output || !src_buf || !cmp_buf || !dec_buf || !state)
+		goto out;
+
+	fill(input, len, corpus);
+	scatter(src_buf, len, src_iov, cnt);
+	scatter(cmp_buf, bound, cmp_iov, cnt);
+	scatter(dec_buf, len, dec_iov, cnt);
+
+	for (int i = 0, off = 0; i < cnt; off += src_iov[i++].iov_len)
+		memcpy(src_iov[i].iov_base, input + off, src_iov[i].iov_len);
+
+	cmp_size = LZ4E_compress_fast_xxh32_iov(src_iov, cnt, cmp_iov, cnt, 1,
+						&sum, state);
+	if (cmp_size <= 0) {
+		fprintf(stderr, "compression failed: %d\n", cmp_size);
+		goto out;
+	}
+
+	truncate_iov(cmp_iov, cnt, (size_t)cmp_size);
+
+	dec_size = LZ4E_decompress_safe_xxh32_iov(cmp_iov, cnt, dec_iov, cnt,
+						  &sum);
+	if (dec_size != (int)len || gather(output, dec_iov, cnt) != len ||
+	    memcmp(input, output, len)) {
+		fprintf(stderr, "decompression failed: %d\n", dec_size);
+		goto out;
+	}
+
+	bad_sum = sum ^ 1;
+	dec_size = LZ4E_decompress_safe_xxh32_iov(cmp_iov, cnt, dec_iov, cnt,
+						  &bad_sum);
+	if (dec_size >= 0) {
+		fprintf(stderr, "checksum mismatch accepted: %d\n", dec_size);
+		goto out;
+	}
+
+	// Without a checksum the data is not verified
+	dec_size = LZ4E_decompress_safe_xxh32_iov(cmp_iov, cnt, dec_iov, cnt,
+						  NULL);
+	if (dec_size != (int)len) {
+		fprintf(stderr, "decompression failed: %d\n", dec_size);
+		goto out;
+	}
+
+	printf("%-6s %7zu bytes, %3d iovecs, xxh32 %08x: %d bytes\n",
+	       corpus_names[corpus], len, cnt, sum, cmp_size);
+	ret = 0;
+
+out:
+	free(input);
+	free(output);
+	free(src_buf);
+	free(cmp_buf);
+	free(dec_buf);
+	free(state);
+	return ret;
+}
+
+// Compress the input as a stream of blocks, each in its own scattered
+// buffers, and decompress every block into its own buffers as well, so
+// matches into the previous blocks never point right before the output.
+// The last 64KB of the output stay within LZ4E_IOV_MAX entries.
+static int stream(enum corpus corpus, size_t block, int blocks, int cnt)
+{
+	const size_t len = block * blocks;
+	const size_t bound = (size_t)LZ4E_compressBound((int)block);
+	const size_t src_span = block + cnt * GAP_MAX;
+	const size_t cmp_span = bound + cnt * GAP_MAX;
+	unsigned char *input = malloc(len);
+	unsigned char *output = malloc(len);
+	unsigned char *src_buf = malloc(src_span * blocks);
+	unsigned char *cmp_buf = malloc(cmp_span * blocks);
+	unsigned char *dec_buf = malloc(src_span * blocks);
+	void *state = calloc(1, LZ4E_sizeofState());
+	void *state_decode = calloc(1, LZ4E_sizeofStreamDecode());
+	struct iovec src_iov[LZ4E_IOV_MAX];
+	struct iovec cmp_iov[LZ4E_IOV_MAX];
+	struct iovec dec_iov[LZ4E_IOV_MAX];
+	size_t total = 0;
+	int ret = 1;
+
+	if (!input || !output || !src_buf || !cmp_buf || !dec_buf || !state ||
+	    !state_decode)
+		goto out;
+
+	fill(input, len, corpus);
+
+	for (int b = 0; b < blocks; b++) {
+		const unsigned char *in = input + b * block;
+		int cmp_size;
+		int dec_size;
+
+		scatter(src_buf + b * src_span, block, src_iov, cnt);
+		scatter(cmp_buf + b * cmp_span, bound, cmp_iov, cnt);
+		scatter(dec_buf + b * src_span, block, dec_iov, cnt);
+
+		for (int i = 0, off = 0; i < cnt; off += src_iov[i++].iov_len)
+			memcpy(src_iov[i].iov_base, in + off,
+			       src_iov[i].iov_len);
+
+		cmp_size = LZ4E_compress_fast_continue_iov(src_iov, cnt,
+							   cmp_iov, cnt, 1,
+							   state);
+		if (cmp_size <= 0) {
+			fprintf(stderr, "compressing block %d failed: %d\n",
+				b, cmp_size);
+			goto out;
+		}
+
+		truncate_iov(cmp_iov, cnt, (size_t)cmp_size);
+
+		dec_size = LZ4E_decompress_safe_continue_iov(cmp_iov, cnt,
+							     dec_iov, cnt,
+							     state_decode);
+		if (dec_size != (int)block) {
+			fprintf(stderr, "decompressing block %d failed: %d\n",
+				b, dec_size);
+			goto out;
+		}
+
+		gather(output + b * block, dec_iov, cnt);
+		total += (size_t)cmp_size;
+	}
+
+	if (memcmp(input, output, len)) {
+		fprintf(stderr, "data mismatch\n");
+		goto out;
+	}
+
+	printf("%-6s %7zu bytes, %3d blocks, %3d iovecs, stream: %zu bytes\n",
+	       corpus_names[corpus], len, blocks, cnt, total);
+	ret = 0;
+
+out:
+	free(input);
+	free(output);
+	free(src_buf);
+	free(cmp_buf);
+	free(dec_buf);
+	free(state);
+	free(state_decode);
+	return ret;
+}
+
+int main(void)
+{
+	static const size_t sizes[] = { 13, 4096, 65536, 256 * 1024 };
+	static const int counts[] = { 1, 3, 64, LZ4E_IOV_MAX };
+	static const size_t targets[] = { 1, 20, 512, 12345 };
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const int n_counts = sizeof(counts) / sizeof(counts[0]);
+	const int n_targets = sizeof(targets) / sizeof(targets[0]);
+	int failures = 0;
+
+	srand(0);
+
+	for (int corpus = 0; corpus < CORPUS_COUNT; corpus++) {
+		for (int s = 0; s < n_sizes; s++) {
+			for (int c = 0; c < n_counts; c++) {
+				failures += round_trip(corpus, sizes[s],
+						       counts[c], counts[c], 0);
+				failures += round_trip(corpus, sizes[s],
+						       counts[c], 1, 1);
+			}
+		}
+
+		for (int t = 0; t < n_targets; t++) {
+			failures += dest_size(corpus, 13, 1, targets[t]);
+			failures += dest_size(corpus, 256 * 1024, 64,
+					      targets[t]);
+		}
+
+		failures += blocks(corpus, 13, 1);
+		failures += blocks(corpus, 65536, 16);
+		failures += blocks(corpus, 256 * 1024 + 5, LZ4E_IOV_MAX);
+
+		for (int s = 0; s < n_sizes; s++)
+			failures += checksum(corpus, sizes[s], 64);
+
+		failures += stream(corpus, 512, 300, 2);
+		failures += stream(corpus, 4096, 40, 16);
+		failures += stream(corpus, 65536, 4, LZ4E_IOV_MAX);
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}